@@ -0,0 +1,575 @@
+// Микробенчмарк сплиттера: пропускная способность и задержка от SplitterPut до SplitterGet
+// на матрице размеров кадра, количества клиентов, режимов сплиттера и нагрузки.
+// Результат - JSON (в stdout или в файл --out), чтобы сравнивать версии между собой.
+// С --cursors вместо этого меряется только PopFrames клиентов таблицы сплиттера из разных потоков вместе со
+// счётчиками клиентов кольцевого буфера, пока один поток кладёт кадры. Разницу раскладок в памяти такой замер
+// показывает, только если потокам хватает ядер (hardware_threads в результате). С --fanout - цена
+// SplitterPut при разном количестве подключённых, но ничего не забирающих клиентов: постоянная, кроме
+// MODE_SINGLE_PRODUCER с OVERFLOW_DROP_OLDEST, где каждое вынужденное удаление обходит подключённых клиентов.
+//
+//   splitter_bench [--quick] [--duration-ms N] [--wait block|spin|yield|adaptive] [--cursors] [--fanout] [--out FILE]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "splitter.h"
+
+typedef std::chrono::steady_clock TClock;
+
+// Кто ограничивает скорость: кладущий кадры поток заполняет весь кадр, а клиенты только читают метку
+// времени, или наоборот - клиенты проходят по всем байтам кадра
+enum TRegime { PRODUCER_BOUND, CONSUMER_BOUND };
+
+struct TBenchCase
+{
+    size_t nFrameSize{0};
+    int nClients{0};
+    TRegime eRegime{PRODUCER_BOUND};
+    ISplitter::Mode eMode{ISplitter::MODE_SHARED_LOCK};
+    ISplitter::WaitStrategy eWait{ISplitter::WAIT_BLOCK};
+};
+
+struct TBenchResult
+{
+    double dSeconds{0};
+    uint64_t nPut{0};
+    uint64_t nDelivered{0};
+    uint64_t nForced{0};
+    uint64_t nLatencyP50{0};
+    uint64_t nLatencyP99{0};
+    uint64_t nLatencyP999{0};
+    TSplitterStats Stats;
+};
+
+static const int MAX_BUFFERS = 16;
+
+static const int TIMEOUT_MSEC = 100;
+
+// Не больше стольких замеров задержки на клиента, чтобы длинный прогон не съел всю память
+static const size_t MAX_LATENCY_SAMPLES = 1 << 16;
+
+static uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( TClock::now().time_since_epoch() ).count();
+}
+
+static uint64_t Percentile( const std::vector<uint64_t>& _Sorted, double _dRank )
+{
+    if ( _Sorted.empty() ) return 0;
+
+    size_t index = static_cast<size_t>( _dRank * ( _Sorted.size() - 1 ) + 0.5 );
+
+    return _Sorted[ std::min( index, _Sorted.size() - 1 ) ];
+}
+
+static void Consume( ISplitter& _Splitter, int _nClientID, TRegime _eRegime, std::vector<uint64_t>& _Latency, uint64_t& _nFrames, uint64_t& _nChecksum )
+{
+    TFramePtr frame;
+
+    while ( true )
+    {
+        int res = _Splitter.SplitterGet( _nClientID, frame, TIMEOUT_MSEC );
+
+        if ( res == ISplitter::ERR_SPLITTER_IS_CLOSED or res == ISplitter::ERR_BAD_CLIENT_ID ) break;
+
+        if ( res != ISplitter::NO_ERROR or not frame ) continue;
+
+        uint64_t now = NowNs();
+
+        uint64_t stamp = 0;
+
+        std::memcpy( &stamp, frame->data(), sizeof( stamp ) );
+
+        if ( _Latency.size() < MAX_LATENCY_SAMPLES ) _Latency.push_back( now - stamp );
+
+        if ( _eRegime == CONSUMER_BOUND )
+        {
+            uint64_t sum = 0;
+
+            for ( uint8_t byte : *frame )
+            {
+                sum += byte;
+            }
+            _nChecksum += sum;
+        }
+        _nFrames++;
+
+        frame.reset();
+    }
+}
+
+static TBenchResult Run( const TBenchCase& _Case, std::chrono::milliseconds _Duration )
+{
+    TBenchResult result;
+
+    auto splitter = SplitterCreate( MAX_BUFFERS, _Case.nClients, _Case.eMode );
+
+    splitter->SplitterWaitStrategySet( _Case.eWait );
+
+    std::vector<int> ids( _Case.nClients );
+
+    for ( int& id : ids )
+    {
+        splitter->SplitterClientAdd( &id );
+    }
+
+    std::vector<std::vector<uint64_t>> latency( _Case.nClients );
+    std::vector<uint64_t> delivered( _Case.nClients, 0 );
+    std::vector<uint64_t> checksum( _Case.nClients, 0 );
+    std::vector<std::thread> consumers;
+
+    for ( int i = 0; i < _Case.nClients; i++ )
+    {
+        latency[ i ].reserve( MAX_LATENCY_SAMPLES );
+
+        consumers.emplace_back( Consume, std::ref( *splitter ), ids[ i ], _Case.eRegime
+                              , std::ref( latency[ i ] ), std::ref( delivered[ i ] ), std::ref( checksum[ i ] ) );
+    }
+
+    auto start = TClock::now();
+    auto stop = start + _Duration;
+
+    uint8_t fill = 0;
+
+    while ( TClock::now() < stop )
+    {
+        TFramePtr frame = splitter->SplitterFrameAcquire( _Case.nFrameSize );
+
+        if ( _Case.eRegime == PRODUCER_BOUND )
+        {
+            std::memset( frame->data(), ++fill, frame->size() );
+        }
+        uint64_t stamp = NowNs();
+
+        std::memcpy( frame->data(), &stamp, sizeof( stamp ) );
+
+        int res = splitter->SplitterPut( frame, TIMEOUT_MSEC );
+
+        if ( res == ISplitter::ERR_FORCED_FRAMES_REMOVE ) result.nForced++;
+
+        result.nPut++;
+    }
+
+    // let consumers drain what is already queued before closing
+    auto drain = TClock::now() + std::chrono::milliseconds( TIMEOUT_MSEC );
+
+    while ( TClock::now() < drain )
+    {
+        int slowest = 0;
+
+        for ( int i = 0; i < _Case.nClients; i++ )
+        {
+            int id = 0;
+            int latencyFrames = 0;
+
+            if ( splitter->SplitterClientGetByIndex( i, &id, &latencyFrames ) )
+            {
+                slowest = std::max( slowest, latencyFrames );
+            }
+        }
+        if ( slowest == 0 ) break;
+
+        std::this_thread::yield();
+    }
+    result.dSeconds = std::chrono::duration<double>( TClock::now() - start ).count();
+
+    splitter->SplitterStatsGet( &result.Stats );
+
+    splitter->SplitterClose();
+
+    for ( auto& consumer : consumers )
+    {
+        consumer.join();
+    }
+
+    std::vector<uint64_t> samples;
+
+    for ( int i = 0; i < _Case.nClients; i++ )
+    {
+        result.nDelivered += delivered[ i ];
+
+        samples.insert( samples.end(), latency[ i ].begin(), latency[ i ].end() );
+    }
+    std::sort( samples.begin(), samples.end() );
+
+    result.nLatencyP50 = Percentile( samples, 0.5 );
+    result.nLatencyP99 = Percentile( samples, 0.99 );
+    result.nLatencyP999 = Percentile( samples, 0.999 );
+
+    return result;
+}
+
+static void WriteJson( std::ostream& _Out, const TBenchCase& _Case, const TBenchResult& _Result )
+{
+    double seconds = std::max( _Result.dSeconds, 1e-9 );
+
+    double bytes = static_cast<double>( _Result.nDelivered ) * _Case.nFrameSize;
+
+    _Out << "    {"
+         << "\"mode\": \"" << ( _Case.eMode == ISplitter::MODE_SINGLE_PRODUCER ? "single_producer" : "shared_lock" ) << "\", "
+         << "\"regime\": \"" << ( _Case.eRegime == CONSUMER_BOUND ? "consumer_bound" : "producer_bound" ) << "\", "
+         << "\"frame_size\": " << _Case.nFrameSize << ", "
+         << "\"clients\": " << _Case.nClients << ", "
+         << "\"seconds\": " << _Result.dSeconds << ", "
+         << "\"frames_put\": " << _Result.nPut << ", "
+         << "\"frames_delivered\": " << _Result.nDelivered << ", "
+         << "\"forced_removals\": " << _Result.nForced << ", "
+         << "\"put_frames_per_sec\": " << _Result.nPut / seconds << ", "
+         << "\"delivered_frames_per_sec\": " << _Result.nDelivered / seconds << ", "
+         << "\"delivered_gb_per_sec\": " << bytes / seconds / 1e9 << ", "
+         << "\"latency_ns\": {"
+         << "\"p50\": " << _Result.nLatencyP50 << ", "
+         << "\"p99\": " << _Result.nLatencyP99 << ", "
+         << "\"p99_9\": " << _Result.nLatencyP999 << "}, "
+         << "\"wait_ms\": {"
+         << "\"slow_clients\": " << _Result.Stats.nSlowClientsWaitNs / 1e6 << ", "
+         << "\"new_frame\": " << _Result.Stats.nNewFrameWaitNs / 1e6 << ", "
+         << "\"exclusive_lock\": " << _Result.Stats.nExclusiveLockWaitNs / 1e6 << ", "
+         << "\"shared_lock\": " << _Result.Stats.nSharedLockWaitNs / 1e6 << "}"
+         << "}";
+}
+
+struct TCursorsResult
+{
+    double dPopNs{0};       // нс на PopFrames, забравший кадр, в пересчёте на поток
+    uint64_t nPopped{0};
+    uint64_t nPut{0};
+    uint64_t nForced{0};    // сдвигов клиентов с удаляемого кадра в конце замера
+};
+
+// Путь MODE_SINGLE_PRODUCER без сплиттера вокруг: _nThreads клиентов таблицы ISplitterClientTable забирают
+// кадры по одному через PopFrames, вызывающий поток кладёт их в ISplitterRing и, как при OVERFLOW_BLOCK,
+// ждёт, пока самый старый кадр заберут все. Каждый сдвиг позиции проходит и по счётчикам клиентов буфера.
+static TCursorsResult RunCursors( int _nThreads, std::chrono::milliseconds _Duration )
+{
+    ISplitterRing ring( MAX_BUFFERS );
+
+    ISplitterClientTable table( _nThreads );
+
+    for ( auto& client : table )
+    {
+        client.Activate( ring, ring.End() );
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> popped{0};
+
+    std::vector<std::thread> threads;
+
+    auto start = TClock::now();
+
+    for ( int t = 0; t < _nThreads; t++ )
+    {
+        threads.emplace_back( [&, t] {
+            auto& client = table[ t ];
+
+            uint64_t generation = client.Generation();
+
+            TFramePtr frame;
+
+            uint64_t count = 0;
+
+            while ( not stop.load( std::memory_order_relaxed ) )
+            {
+                if ( client.PopFrames( ring, &frame, 1, generation ) > 0 )
+                {
+                    count++;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+            popped += count;
+        } );
+    }
+
+    TCursorsResult result;
+
+    auto pFrame = std::make_shared<TFrame>( 64, 0 );
+
+    auto deadline = start + _Duration;
+
+    while ( TClock::now() < deadline )
+    {
+        for ( int i = 0; i < 1024; i++, result.nPut++ )
+        {
+            // the ring stays within its capacity and never grows under the readers
+            if ( ring.size() >= static_cast<size_t>( MAX_BUFFERS ) )
+            {
+                while ( SplitterHasSlowClients( ring ) && TClock::now() < deadline )
+                {
+                    std::this_thread::yield();
+                }
+
+                // out of time: the slow clients are moved off the frame, as on a forced removal
+                if ( SplitterHasSlowClients( ring ) )
+                {
+                    for ( auto& client : table )
+                    {
+                        if ( client.FrameIncrement( ring, ring.Begin() ) ) result.nForced++;
+                    }
+                }
+                ring.pop_front();
+            }
+            ring.push_back( pFrame );
+        }
+    }
+    stop = true;
+
+    for ( auto& thread : threads )
+    {
+        thread.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>( TClock::now() - start ).count();
+
+    result.nPopped = popped;
+    result.dPopNs = ns * _nThreads / std::max<uint64_t>( result.nPopped, 1 );
+
+    return result;
+}
+
+static void WriteCursorsJson( std::ostream& _Out, std::chrono::milliseconds _Duration, const std::vector<int>& _Threads )
+{
+    _Out << "{\n"
+         << "  \"benchmark\": \"splitter_bench_cursors\",\n"
+         << "  \"duration_ms\": " << _Duration.count() << ",\n"
+         << "  \"max_buffers\": " << MAX_BUFFERS << ",\n"
+         << "  \"client_size\": " << sizeof( ISplitterClient ) << ",\n"
+         << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+         << "  \"cases\": [\n";
+
+    for ( size_t i = 0; i < _Threads.size(); i++ )
+    {
+        TCursorsResult result = RunCursors( _Threads[ i ], _Duration );
+
+        _Out << "    {"
+             << "\"threads\": " << _Threads[ i ] << ", "
+             << "\"ns_per_pop\": " << result.dPopNs << ", "
+             << "\"popped\": " << result.nPopped << ", "
+             << "\"put\": " << result.nPut << ", "
+             << "\"forced\": " << result.nForced << "}"
+             << ( i + 1 < _Threads.size() ? ",\n" : "\n" );
+    }
+    _Out << "  ]\n}\n";
+}
+
+// Кладём кадры без перерыва, клиенты только подключены: переполнение на каждом кадре, возвращаем нс на кадр
+static double RunFanout( int _nClients, ISplitter::Mode _eMode, ISplitter::OverflowPolicy _eOverflow, std::chrono::milliseconds _Duration )
+{
+    auto splitter = SplitterCreate( MAX_BUFFERS, _nClients, _eMode, _eOverflow );
+
+    for ( int i = 0; i < _nClients; i++ )
+    {
+        int id = 0;
+
+        splitter->SplitterClientAdd( &id );
+    }
+
+    auto pFrame = std::make_shared<TFrame>( 64, 0 );
+
+    uint64_t count = 0;
+
+    auto start = TClock::now();
+
+    auto deadline = start + _Duration;
+
+    while ( TClock::now() < deadline )
+    {
+        for ( int i = 0; i < 1024; i++, count++ )
+        {
+            splitter->SplitterPut( pFrame, 0 );
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>( TClock::now() - start ).count();
+
+    return ns / std::max<uint64_t>( count, 1 );
+}
+
+static void WriteFanoutJson( std::ostream& _Out, std::chrono::milliseconds _Duration, const std::vector<int>& _Clients )
+{
+    _Out << "{\n"
+         << "  \"benchmark\": \"splitter_bench_fanout\",\n"
+         << "  \"duration_ms\": " << _Duration.count() << ",\n"
+         << "  \"max_buffers\": " << MAX_BUFFERS << ",\n"
+         << "  \"client_size\": " << sizeof( ISplitterClient ) << ",\n"
+         << "  \"cases\": [\n";
+
+    bool first = true;
+
+    for ( auto mode : { ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER } )
+    {
+        for ( auto overflow : { ISplitter::OVERFLOW_DROP_OLDEST, ISplitter::OVERFLOW_DROP_NEWEST } )
+        {
+            for ( int clients : _Clients )
+            {
+                double ns = RunFanout( clients, mode, overflow, _Duration );
+
+                _Out << ( first ? "" : ",\n" ) << "    {"
+                     << "\"mode\": \"" << ( mode == ISplitter::MODE_SINGLE_PRODUCER ? "single_producer" : "shared_lock" ) << "\", "
+                     << "\"overflow\": \"" << ( overflow == ISplitter::OVERFLOW_DROP_OLDEST ? "drop_oldest" : "drop_newest" ) << "\", "
+                     << "\"clients\": " << clients << ", "
+                     << "\"put_ns\": " << ns << "}";
+
+                first = false;
+
+                std::cerr << "fanout " << clients << " clients done" << std::endl;
+            }
+        }
+    }
+    _Out << "\n  ]\n}\n";
+}
+
+static const char* WAIT_NAMES[] = { "block", "spin", "yield", "adaptive" };
+
+int main( int argc, char** argv )
+{
+    bool quick = false;
+
+    ISplitter::WaitStrategy wait = ISplitter::WAIT_BLOCK;
+
+    bool cursors = false;
+
+    bool fanout = false;
+
+    bool badArgs = false;
+
+    int durationMsec = 200;
+
+    std::string outPath;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[ i ];
+
+        if ( arg == "--quick" )
+        {
+            quick = true;
+        }
+        else if ( arg == "--duration-ms" and i + 1 < argc )
+        {
+            durationMsec = std::max( 1, std::atoi( argv[ ++i ] ) );
+        }
+        else if ( arg == "--wait" and i + 1 < argc )
+        {
+            std::string name = argv[ ++i ];
+
+            auto it = std::find( std::begin( WAIT_NAMES ), std::end( WAIT_NAMES ), name );
+
+            badArgs = it == std::end( WAIT_NAMES );
+
+            wait = static_cast<ISplitter::WaitStrategy>( it - std::begin( WAIT_NAMES ) );
+        }
+        else if ( arg == "--cursors" )
+        {
+            cursors = true;
+        }
+        else if ( arg == "--fanout" )
+        {
+            fanout = true;
+        }
+        else if ( arg == "--out" and i + 1 < argc )
+        {
+            outPath = argv[ ++i ];
+        }
+        else
+        {
+            badArgs = true;
+        }
+
+        if ( badArgs )
+        {
+            std::cerr << "usage: " << argv[ 0 ] << " [--quick] [--duration-ms N] [--wait block|spin|yield|adaptive] [--cursors] [--fanout] [--out FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<size_t> sizes = { 64, 4 << 10, 64 << 10, 1 << 20, 8 << 20 };
+    std::vector<int> clients = { 1, 4, 16, 64, 256 };
+
+    if ( quick )
+    {
+        sizes = { 64, 64 << 10 };
+        clients = { 1, 16 };
+        durationMsec = std::min( durationMsec, 50 );
+    }
+
+    std::ostringstream json;
+
+    if ( cursors )
+    {
+        std::vector<int> threads = { 1, 2, 4, 8 };
+
+        if ( quick ) threads = { 1, 2 };
+
+        WriteCursorsJson( json, std::chrono::milliseconds( durationMsec ), threads );
+    }
+    else if ( fanout )
+    {
+        std::vector<int> fanoutClients = { 1, 1000, 10000, 100000 };
+
+        if ( quick ) fanoutClients = { 1, 1000 };
+
+        WriteFanoutJson( json, std::chrono::milliseconds( durationMsec ), fanoutClients );
+    }
+    else
+    {
+        std::vector<TBenchCase> cases;
+
+        for ( auto mode : { ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER } )
+        {
+            for ( auto regime : { PRODUCER_BOUND, CONSUMER_BOUND } )
+            {
+                for ( size_t size : sizes )
+                {
+                    for ( int count : clients )
+                    {
+                        cases.push_back( { size, count, regime, mode, wait } );
+                    }
+                }
+            }
+        }
+
+        json << "{\n"
+             << "  \"benchmark\": \"splitter_bench\",\n"
+             << "  \"duration_ms\": " << durationMsec << ",\n"
+             << "  \"wait\": \"" << WAIT_NAMES[ wait ] << "\",\n"
+             << "  \"max_buffers\": " << MAX_BUFFERS << ",\n"
+             << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+             << "  \"cases\": [\n";
+
+        for ( size_t i = 0; i < cases.size(); i++ )
+        {
+            TBenchResult result = Run( cases[ i ], std::chrono::milliseconds( durationMsec ) );
+
+            WriteJson( json, cases[ i ], result );
+
+            json << ( i + 1 < cases.size() ? ",\n" : "\n" );
+
+            std::cerr << "case " << i + 1 << "/" << cases.size() << " done" << std::endl;
+        }
+        json << "  ]\n}\n";
+    }
+
+    if ( outPath.empty() )
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream out( outPath );
+
+        out << json.str();
+    }
+    return 0;
+}
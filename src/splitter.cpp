@@ -1,8 +1,8 @@
 #include "splitter.h"
 
+#include <algorithm>
 #include <initializer_list>
 #include <memory>
-#include <numeric>
 #include <ratio>
 #include <utility>
 #include <iostream>
@@ -11,21 +11,42 @@
 #include <thread>
 
 #include "easylogging++.h"
+#include "splitter_trace.h"
+#include "splitter_wait.h"
 
 INITIALIZE_EASYLOGGINGPP
 
 using namespace std::chrono_literals;
 
-std::shared_ptr<ISplitter>    SplitterCreate(IN int _nMaxBuffers, IN int _nMaxClients)
+static uint64_t ElapsedNs(std::chrono::steady_clock::time_point _Start)
 {
-    return std::make_shared<ISplitter>(_nMaxBuffers, _nMaxClients);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - _Start ).count();
+}
+
+// The millisecond timeout of the public calls becomes a deadline once, waits never re-derive it
+static std::chrono::steady_clock::time_point DeadlineIn(int _nTimeOutMsec)
+{
+    return std::chrono::steady_clock::now() + _nTimeOutMsec*1ms;
+}
+
+std::shared_ptr<ISplitter>    SplitterCreate(IN int _nMaxBuffers, IN int _nMaxClients, IN ISplitter::Mode _eMode, IN ISplitter::OverflowPolicy _eOverflow, IN uint64_t _nMaxBytes)
+{
+    return std::make_shared<ISplitter>(_nMaxBuffers, _nMaxClients, _eMode, _eOverflow, _nMaxBytes);
 }
 
 // ISplitter интерфейс
 
-ISplitter::ISplitter(int _nMaxBuffers, int _nMaxClients)
-    : m_nMaxBuffers(_nMaxBuffers)
+ISplitter::ISplitter(int _nMaxBuffers, int _nMaxClients, Mode _eMode, OverflowPolicy _eOverflow, uint64_t _nMaxBytes)
+    : m_eMode(_eMode)
+    , m_eOverflow(_eOverflow)
+    // clients move only under m_Mutex there, so the ring may carry them off dropped frames
+    , m_Frames(_nMaxBuffers + 1, _eMode == MODE_SHARED_LOCK)
+    , m_Clients(_nMaxClients)
+    , m_ClientsIds(_nMaxClients)
+    , m_Limits{_nMaxBuffers, _nMaxBytes}
     , m_nMaxClients(_nMaxClients)
+    // enough for every frame in the buffer, one held by each client and one being filled
+    , m_pFramePool(ISplitterFramePool::Create(std::max(_nMaxBuffers, 0) + std::max(_nMaxClients, 0) + 2))
 {
     if (m_nMaxClients > 0 && m_nMaxClients > 0)
     {
@@ -35,15 +56,29 @@ ISplitter::ISplitter(int _nMaxBuffers, int _nMaxClients)
     {
         return;
     }
-    m_ClientsIdsBag.resize(m_nMaxClients);
-    std::iota(std::begin(m_ClientsIdsBag), std::end(m_ClientsIdsBag), 1);
 }
 
 ISplitter::~ISplitter()
 {
     this->SplitterClose();
 
-    m_Clients.clear();
+    // pending asynchronous waits finish with ERR_SPLITTER_IS_CLOSED while the splitter is still whole
+    std::unique_ptr<ISplitterTimer> pTimer;
+    std::unique_ptr<ISplitterThreadPool> pExecutorPool;
+    std::unique_ptr<ISplitterThreadPool> pDispatcher;
+
+    {
+        std::lock_guard<std::mutex> locker(m_AsyncMutex);
+
+        pTimer.swap( m_pTimer );
+        pExecutorPool.swap( m_pExecutorPool );
+        pDispatcher.swap( m_pDispatcher );
+    }
+
+    pTimer.reset();
+    pDispatcher.reset();
+    pExecutorPool.reset();
+
     m_Frames.clear();
 }
 
@@ -51,134 +86,404 @@ bool    ISplitter::SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClient
 {
     if ( m_bIsClosed ) return false;
 
-    *_pnMaxBuffers = m_nMaxBuffers;
+    *_pnMaxBuffers = m_Limits.nMaxBuffers;
     *_pnMaxClients = m_nMaxClients;
 
     return true;
 }
 
-// Кладём данные в очередь. Если какой-то клиент не успел ещё забрать свои данные, и количество буферов (задержка) для него больше максимального значения, то ждём пока не освободятся буфера (клиент заберет данные) в течении _nTimeOutMsec. Если по истечению времени данные так и не забраны, то удаляем старые данные для этого клиента, добавляем новые (по принципу FIFO) (*). Возвращаем код ошибки, который дает понять что один или несколько клиентов “пропустили” свои данные.
+// То же, а также ограничение на размер кадров в очереди (0 - без ограничения) и их текущий размер в байтах.
+bool    ISplitter::SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients, OUT uint64_t* _pnMaxBytes, OUT uint64_t* _pnRetainedBytes)
+{
+    if ( not SplitterInfoGet( _pnMaxBuffers, _pnMaxClients ) ) return false;
+
+    *_pnMaxBytes = m_Limits.nMaxBytes;
+    *_pnRetainedBytes = m_Frames.RetainedBytes();
+
+    return true;
+}
+
+// Кладём данные в очередь. Политика OVERFLOW_BLOCK: если какой-то клиент не успел ещё забрать свои данные, и количество буферов (задержка) для него больше максимального значения, то ждём пока не освободятся буфера (клиент заберет данные) в течении _nTimeOutMsec. Если по истечению времени данные так и не забраны, то удаляем старые данные для этого клиента, добавляем новые (по принципу FIFO) (*). Возвращаем код ошибки, который дает понять что один или несколько клиентов “пропустили” свои данные.
 int    ISplitter::SplitterPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut, IN int _nTimeOutMsec)
 {
-    LOG(DEBUG);
+    return PutFrames( &_pVecPut, 1, DeadlineIn( _nTimeOutMsec ) );
+}
+
+// То же, но медленных клиентов ждём до момента _Deadline.
+int    ISplitter::SplitterPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut, IN TDeadline _Deadline)
+{
+    return PutFrames( &_pVecPut, 1, _Deadline );
+}
+
+// Кладём кадр, никого не ожидая. При OVERFLOW_BLOCK, если кадр переполнит очередь, а самый старый кадр ещё не забрали медленные клиенты, кадр не кладём и возвращаем ERR_TIMEOUT. При остальных политиках - как SplitterPut.
+int    ISplitter::SplitterTryPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut)
+{
+    return PutFrames( &_pVecPut, 1, TDeadline::min(), true );
+}
+
+// Кладём кадр в очередь, как SplitterPut, и узнаём, когда он больше не нужен: _OnReleased вызывается, когда все клиенты забрали или пропустили кадр и отпустили ссылки на него: забранный всеми кадр сплиттер убирает из очереди сразу, не дожидаясь её переполнения. Ссылки, оставшиеся у вызывающего, не учитываются. _OnReleased может быть вызван под блокировкой сплиттера и не должен обращаться к нему.
+int    ISplitter::SplitterPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut, IN TFrameRelease _OnReleased, IN int _nTimeOutMsec)
+{
+    if ( not _OnReleased ) return PutFrames( &_pVecPut, 1, DeadlineIn( _nTimeOutMsec ) );
+
+    // a separate owner for the same frame: it dies with the last reference handed out by the splitter
+    TFramePtr pFrame( _pVecPut.get(), [pOwner = _pVecPut, OnReleased = std::move(_OnReleased)] ( TFrame* ) mutable {
+        pOwner.reset();
+
+        OnReleased();
+    });
+
+    return PutFrames( &pFrame, 1, DeadlineIn( _nTimeOutMsec ) );
+}
 
-    std::list<int> slowClients;
+// Берём из пула сплиттера кадр размера _nSize, чтобы заполнить его и положить в очередь. Когда пропадает последняя ссылка на кадр, его буфер возвращается в пул, а не освобождается. Содержимое кадра не определено.
+TFramePtr    ISplitter::SplitterFrameAcquire(IN size_t _nSize)
+{
+    return m_pFramePool->Acquire( _nSize );
+}
+
+// Резервируем в памяти сплиттера буфер под кадр размера _nSize: данные пишем сразу в _Reservation.pData, без промежуточного вектора. Клиенты увидят кадр после SplitterCommit, если резерв просто уничтожить, буфер вернётся в пул.
+bool    ISplitter::SplitterReserve(IN size_t _nSize, OUT TFrameReservation& _Reservation)
+{
+    if ( m_bIsClosed ) return false;
+
+    _Reservation.pFrame = m_pFramePool->Acquire( _nSize );
+    _Reservation.pData = _Reservation.pFrame->data();
+    _Reservation.nSize = _nSize;
+
+    return true;
+}
+
+// Публикуем зарезервированный кадр, как SplitterPut. _nSize - сколько байт реально записано, не больше зарезервированного, иначе возвращаем ERR_COMMIT_TOO_LARGE и резерв не трогаем. Резерв после публикации пуст.
+int    ISplitter::SplitterCommit(IN TFrameReservation& _Reservation, IN size_t _nSize, IN int _nTimeOutMsec)
+{
+    if ( not _Reservation.pFrame ) return ERR_NO_RESERVATION;
+
+    // the caller has written past pData: publishing the reserved length would hide it
+    if ( _nSize > _Reservation.nSize ) return ERR_COMMIT_TOO_LARGE;
+
+    // shrinking keeps the buffer in place
+    if ( _nSize < _Reservation.pFrame->size() ) _Reservation.pFrame->resize( _nSize );
+
+    auto pFrame = std::move( _Reservation.pFrame );
+
+    _Reservation = TFrameReservation();
+
+    return PutFrames( &pFrame, 1, DeadlineIn( _nTimeOutMsec ) );
+}
+
+// Кладём в очередь сразу несколько кадров, как SplitterPut. _nTimeOutMsec - общее время ожидания медленных клиентов на все кадры.
+int    ISplitter::SplitterPutBatch(IN std::span<const TFramePtr> _Frames, IN int _nTimeOutMsec)
+{
+    return PutFrames( _Frames.data(), static_cast<int>( _Frames.size() ), DeadlineIn( _nTimeOutMsec ) );
+}
+
+int    ISplitter::PutFrames(const TFramePtr* _pFrames, int _nFrames, TDeadline _Deadline, bool _bTry)
+{
+    if ( m_eMode == MODE_SINGLE_PRODUCER ) return SingleProducerPut( _pFrames, _nFrames, _Deadline, _bTry );
 
     // add frame, check slow and quick clients
-    TWriteLock write_locker(m_Mutex);
+    TWriteLock write_locker(m_Mutex, std::defer_lock);
+
+    LockCounted(write_locker, m_Counters.nExclusiveLockWaits, m_Counters.nExclusiveLockWaitNs);
 
     if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
 
-    this->m_Frames.push_back(_pVecPut);
+    if ( _bTry && MustWaitFor( *_pFrames ) ) return ERR_TIMEOUT;
 
-    auto newBuf = --m_Frames.end();
+    int res = 0;
 
-    for( auto&& [nClientId, pClient] : m_Clients)
+    while ( _nFrames > 0 )
     {
-        if ( pClient->NextFrame() == m_Frames.end() )
+        uint64_t nPublishNs = SplitterNowNs();
+
+        // clients waiting at the end of the buffer now point to the new frame
+        do
         {
-            pClient->SetNextFrame( newBuf );
+            if ( m_eOverflow == OVERFLOW_DROP_NEWEST && NoRoomFor( *_pFrames ) && DropNewFrame() )
+            {
+                SPLITTER_TRACE( TRACE_DROP_NEW, m_Frames.End(), 0 );
+
+                TSplitterCounters::Add( m_Counters.nForcedRemovals, 1 );
+
+                _pFrames++;
+
+                res = ERR_FORCED_FRAMES_REMOVE;
+
+                continue;
+            }
+
+            SPLITTER_TRACE( TRACE_PUT, m_Frames.End(), *_pFrames ? (*_pFrames)->size() : 0 );
+
+            TSplitterCounters::Add( m_Counters.nFramesPut, 1 );
+
+            this->m_Frames.push_back(*_pFrames++, nPublishNs);
         }
+        while ( --_nFrames > 0 && not Overflowed() );
 
-        if ( pClient->NextFrame()  == m_Frames.begin() )
+        WakeParkedClients();
+
+        // without clients the frame is consumed as soon as it is put
+        ReleaseConsumedFrames();
+
+        while ( Overflowed() )
         {
-            slowClients.push_back( nClientId );
-        }
-    }
+            int nRes = RemoveOldestFrame( write_locker, _Deadline );
 
-    LOG(DEBUG) << "Notify waiting clients about new data arrival";
+            if ( nRes == ERR_SPLITTER_IS_CLOSED ) return nRes;
 
-    m_NewFrameUploaded.notify_all();
+            if ( nRes != 0 ) res = nRes;
+        }
+    }
+    return res;
+}
 
+int    ISplitter::RemoveOldestFrame(TWriteLock& _Locker, TDeadline _Deadline)
+{
     // wait for slow
 
     if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
 
-    if ( m_Frames.size() <= m_nMaxBuffers ) return 0;
-
-    if ( not slowClients.empty() )
+    if ( HasSlowClients() && m_eOverflow == OVERFLOW_BLOCK )
     {
-        LOG(DEBUG) << "Wait for slow clients to get their data";
+        SPLITTER_TRACE( TRACE_WAIT_SLOW, m_Frames.Begin(), m_Frames.ClientsAt( m_Frames.Begin() ) );
 
-        m_NoSlowClients.wait_for(write_locker, _nTimeOutMsec*1ms);
+        m_nPutWaiters++;
 
-        if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+        auto start = std::chrono::steady_clock::now();
 
-        if ( m_Frames.empty() ) return 0;
+        // spinning without the lock: the slow clients need it to move on
+        if ( m_eWait.load( std::memory_order_relaxed ) != WAIT_BLOCK )
+        {
+            _Locker.unlock();
 
-        slowClients = SlowClients();
-    }
+            // a get may also release the consumed frames and leave the queue within its limits
+            Spin( _Deadline, [this] { return m_bIsClosed || not Overflowed() || not HasSlowClients(); } );
 
-    // remove last frame
+            LockCounted(_Locker, m_Counters.nExclusiveLockWaits, m_Counters.nExclusiveLockWaitNs);
+        }
 
-    int res = 0;
+        // a wakeup before the deadline that did not free the oldest frame is no reason to drop it
+        if ( MayPark() ) m_NoSlowClients.Wait(_Locker, _Deadline, [this] { return m_bIsClosed || not Overflowed() || not HasSlowClients(); });
 
-    for (auto& id : slowClients)
-    {
-        auto ppClient = m_Clients.find(id);
+        TSplitterCounters::Add( m_Counters.nSlowClientsWaitNs, ElapsedNs( start ) );
 
-        auto pClient = ppClient->second;
+        m_nPutWaiters--;
 
-        pClient->FrameIncrement();
+        if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
 
-        res = ERR_FORCED_FRAMES_REMOVE;
+        // flushed or already trimmed by another producer
+        if ( not Overflowed() ) return 0;
     }
 
-    LOG(DEBUG) << "Remove oldest frame";
+    // remove last frame
+
+    TFrameSeq nOldest = m_Frames.Begin();
+
+    // exact under the exclusive lock: nobody else moves the clients
+    int nSlow = m_Frames.ClientsAt( nOldest );
+
+    // no pass over the clients: the ring carries them to the next frame, and each skips
+    // the dropped frames itself the next time it takes frames
+    int res = nSlow > 0 ? ERR_FORCED_FRAMES_REMOVE : 0;
+
+    SPLITTER_TRACE( TRACE_REMOVE_OLDEST, nOldest, nSlow );
+
+    if ( res != 0 ) TSplitterCounters::Add( m_Counters.nForcedRemovals, 1 );
 
     m_Frames.pop_front();
 
     return res;
 }
 
+// Убираем из очереди самые старые кадры, которые все клиенты уже забрали или пропустили: их больше никто
+// не прочтёт, новые клиенты начинают с конца очереди. Очередь при этом меняет только вызывающий поток.
+void    ISplitter::ReleaseConsumedFrames()
+{
+    // clients behind the oldest frame are counted on it: a free oldest frame is behind every cursor,
+    // and cursors only move forward, so nobody reads it again
+    while ( not m_Frames.empty() && not HasSlowClients() )
+    {
+        m_Frames.pop_front();
+    }
+}
+
 // По идентификатору клиента запрашиваем данные, если данных пока нет, то ожидаем _nTimeOutMsec пока не будут добавлены новые данные, в случае превышения времени ожидания - возвращаем ошибку.
-int    ISplitter::SplitterGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, IN int _nTimeOutMsec)
+int    ISplitter::SplitterGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped)
 {
-    TReadLock locker(m_Mutex);
+    TFramePtr pFrame;
 
-    LOG(DEBUG);
+    int nFrames = 0;
+
+    int res = GetFrames( _nClientID, &pFrame, 1, &nFrames, DeadlineIn( _nTimeOutMsec ), _pnSkipped );
+
+    ArmClientFd( _nClientID );
+
+    if ( res == 0 ) _pVecGet = std::move( pFrame );
+
+    return res;
+}
+
+// То же, но кадр ждём до момента _Deadline.
+int    ISplitter::SplitterGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, IN TDeadline _Deadline, OUT uint64_t* _pnSkipped)
+{
+    TFramePtr pFrame;
+
+    int nFrames = 0;
+
+    int res = GetFrames( _nClientID, &pFrame, 1, &nFrames, _Deadline, _pnSkipped );
+
+    ArmClientFd( _nClientID );
+
+    if ( res == 0 ) _pVecGet = std::move( pFrame );
+
+    return res;
+}
+
+// Забираем кадр, если он уже есть, иначе сразу возвращаем ERR_TIMEOUT, не ожидая.
+int    ISplitter::SplitterTryGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, OUT uint64_t* _pnSkipped)
+{
+    return SplitterGet( _nClientID, _pVecGet, TDeadline::min(), _pnSkipped );
+}
+
+// Забираем сразу все накопившиеся для клиента кадры, но не больше, чем помещается в _Frames, в _pnFrames - сколько забрали. Ждём, как SplitterGet, только если кадров нет совсем. В пустой _Frames забрать нечего: сразу ERR_TIMEOUT.
+int    ISplitter::SplitterGetBatch(IN int _nClientID, OUT std::span<TFramePtr> _Frames, OUT int* _pnFrames, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped)
+{
+    *_pnFrames = 0;
+
+    if ( _Frames.empty() ) return ERR_TIMEOUT;
+
+    int res = GetFrames( _nClientID, _Frames.data(), static_cast<int>( _Frames.size() ), _pnFrames, DeadlineIn( _nTimeOutMsec ), _pnSkipped );
+
+    ArmClientFd( _nClientID );
+
+    return res;
+}
+
+int    ISplitter::GetFrames(int _nClientID, TFramePtr* _pFrames, int _nMaxFrames, int* _pnFrames, TDeadline _Deadline, uint64_t* _pnSkipped)
+{
+    if ( m_eMode == MODE_SINGLE_PRODUCER )
+    {
+        if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+
+        auto pClient = FindClient(_nClientID);
+
+        if ( pClient == nullptr ) return ERR_BAD_CLIENT_ID;
+
+        int res = SingleProducerGet( *pClient, pClient->Generation(), _pFrames, _nMaxFrames, _pnFrames, _Deadline );
+
+        if ( res == 0 && _pnSkipped ) *_pnSkipped = pClient->TakeSkipped( m_Frames );
+
+        return res;
+    }
+
+    auto& counters = ClientCounters(_nClientID);
+
+    TReadLock locker(m_Mutex, std::defer_lock);
+
+    LockCounted(locker, counters.nSharedLockWaits, counters.nSharedLockWaitNs);
 
     if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
 
-    if ( _nClientID > m_nMaxClients || _nClientID < 1 ) return ERR_BAD_CLIENT_ID;
+    auto pClient = FindClient(_nClientID);
 
-    auto ppClient = m_Clients.find(_nClientID);
+    if ( pClient == nullptr ) return ERR_BAD_CLIENT_ID;
 
-    if ( ppClient == m_Clients.end() ) return ERR_BAD_CLIENT_ID;
+    // while we wait the id may be removed and given to a new owner, whose frames are not ours
+    uint64_t nGeneration = pClient->Generation();
 
-    auto& pClient = ppClient->second;
+    TFrameSeq nFrame = 0;
 
-    if ( pClient->NextFrame() == m_Frames.end() )
+    // a wakeup without a frame does not end the wait, only the deadline does
+    while ( ( *_pnFrames = pClient->PopFrames( m_Frames, _pFrames, _nMaxFrames, nGeneration, &nFrame ) ) == 0 )
     {
-        LOG(DEBUG) << "Wait for new data upload";
+        if ( std::chrono::steady_clock::now() >= _Deadline )
+        {
+            TSplitterCounters::Add( counters.nTimeouts, 1 );
+
+            return ERR_TIMEOUT;
+        }
+
+        SPLITTER_TRACE( TRACE_WAIT_FRAME, _nClientID, pClient->NextFrame() );
+
+        if ( m_eWait.load( std::memory_order_relaxed ) != WAIT_BLOCK )
+        {
+            locker.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+
+            bool bReady = Spin( _Deadline, [&] { return m_bIsClosed || not pClient->Active( nGeneration ) || pClient->NextFrame() < m_Frames.End(); } );
+
+            TSplitterCounters::Add( counters.nNewFrameWaitNs, ElapsedNs( start ) );
+
+            LockCounted(locker, counters.nSharedLockWaits, counters.nSharedLockWaitNs);
 
-        auto res = m_NewFrameUploaded.wait_for(locker, _nTimeOutMsec*1ms);
+            if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+
+            if ( not pClient->Active( nGeneration ) ) return ERR_BAD_CLIENT_ID;
+
+            if ( bReady || not MayPark() ) continue;
+        }
+
+        // parked under the lock: no frame can be put before the producer sees us
+        ParkClient( *pClient );
+
+        // but SplitterClientRemove runs beside us under its shared lock: its wakeup may have come before we parked
+        bool bReady = not pClient->Active( nGeneration ) || pClient->NextFrame() < m_Frames.End();
+
+        locker.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+
+        bool bWoken = bReady || pClient->Wait( _Deadline );
+
+        TSplitterCounters::Add( counters.nNewFrameWaitNs, ElapsedNs( start ) );
+
+        UnparkClient( *pClient );
+
+        LockCounted(locker, counters.nSharedLockWaits, counters.nSharedLockWaitNs);
 
         if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
 
-        if ( res == std::cv_status::timeout ) return ERR_TIMEOUT;
+        if ( not pClient->Active( nGeneration ) ) return ERR_BAD_CLIENT_ID;
 
-        if ( pClient->NextFrame() == m_Frames.end() ) return ERR_SPOUROIUS_WAKEUP;
+        if ( bWoken && pClient->NextFrame() >= m_Frames.End() ) TSplitterCounters::Add( counters.nSpuriousWakeups, 1 );
     }
 
-    LOG(DEBUG) << "Give frame to client, buf unread: " << std::distance( pClient->NextFrame(), m_Frames.end() ) - 1;
+    TSplitterCounters::Add( counters.nFramesGot, *_pnFrames );
 
-    _pVecGet = pClient->PopFrame();
+    SPLITTER_TRACE( TRACE_GET, _nClientID, m_Frames.End() - pClient->NextFrame() );
 
-    if ( SlowClients().empty() )
+    // only the client leaving the oldest frame may release the frames behind everybody and a waiting producer
+    if ( nFrame == m_Frames.Begin() && not HasSlowClients() )
     {
-        LOG(DEBUG) << "Notify about unneeded oldest frame";
+        {
+            std::lock_guard<std::mutex> release_locker(m_ReleaseMutex);
+
+            ReleaseConsumedFrames();
+        }
+
+        if ( m_nPutWaiters > 0 )
+        {
+            SPLITTER_TRACE( TRACE_NOTIFY_PRODUCER, _nClientID, nFrame );
 
-        m_NoSlowClients.notify_all();
+            m_NoSlowClients.Notify();
+        }
     }
 
+    if ( _pnSkipped ) *_pnSkipped = pClient->TakeSkipped( m_Frames );
+
     return 0;
 }
 
 // Сбрасываем все буфера, прерываем все ожидания.
 int    ISplitter::SplitterFlush()
 {
-    TWriteLock locker(m_Mutex);
+    if ( m_eMode == MODE_SINGLE_PRODUCER ) return SingleProducerFlush();
+
+    TWriteLock locker(m_Mutex, std::defer_lock);
+
+    LockCounted(locker, m_Counters.nExclusiveLockWaits, m_Counters.nExclusiveLockWaitNs);
 
     LOG(DEBUG);
 
@@ -186,11 +491,11 @@ int    ISplitter::SplitterFlush()
 
     m_Frames.clear();
 
-    for (auto&& [nClientId, pClient] : m_Clients)
+    for (auto& client : m_Clients)
     {
-        if ( pClient->NextFrame() != m_Frames.end() )
+        if ( client.Active() && client.NextFrame() != m_Frames.End() )
         {
-            pClient->SetNextFrame( m_Frames.end() );
+            client.SetNextFrame( m_Frames, m_Frames.End() );
         }
     }
     return 0;
@@ -199,23 +504,27 @@ int    ISplitter::SplitterFlush()
 // Добавляем нового клиента - возвращаем уникальный идентификатор клиента.
 bool    ISplitter::SplitterClientAdd(OUT int* _pnClientID)
 {
-    TWriteLock locker(m_Mutex);
+    // the table of clients never changes: activating a slot does not stop the consumers
+    std::lock_guard<std::mutex> locker(m_ClientsMutex);
 
     LOG(DEBUG);
 
     if ( m_bIsClosed ) return false;
 
-    if ( m_ClientsIdsBag.empty() ) return false;
+    int id = m_ClientsIds.Acquire();
 
-    int id = m_ClientsIdsBag.front();
+    if ( id == 0 ) return false;
 
     *_pnClientID = id;
 
-    m_ClientsIdsBag.pop_front();
+    // in MODE_SHARED_LOCK a producer may re-lay the ring out, with the clients' counts, under the exclusive lock
+    TReadLock read_locker(m_Mutex, std::defer_lock);
 
-    auto&& pClient = std::make_shared<ISplitterClient>(id, m_Frames.end() );
+    if ( m_eMode == MODE_SHARED_LOCK ) LockCounted(read_locker, m_Counters.nSharedLockWaits, m_Counters.nSharedLockWaitNs);
 
-    m_Clients.insert( {id, pClient } );
+    m_Clients[id - 1].Activate( m_Frames, m_Frames.End() );
+
+    m_nClientsCount++;
 
     return true;
 }
@@ -223,84 +532,816 @@ bool    ISplitter::SplitterClientAdd(OUT int* _pnClientID)
 // Удаляем клиента по идентификатору, если клиент находиться в процессе ожидания буфера, то прерываем ожидание.
 bool    ISplitter::SplitterClientRemove(IN int _nClientID)
 {
-    TWriteLock locker(m_Mutex);
+    std::lock_guard<std::mutex> locker(m_ClientsMutex);
 
     LOG(DEBUG);
 
     if ( m_bIsClosed ) return false;
 
-    auto ppClient = m_Clients.find(_nClientID);
+    auto pClient = FindClient(_nClientID);
+
+    if ( pClient == nullptr ) return false;
+
+    // as in SplitterClientAdd
+    TReadLock read_locker(m_Mutex, std::defer_lock);
+
+    if ( m_eMode == MODE_SHARED_LOCK ) LockCounted(read_locker, m_Counters.nSharedLockWaits, m_Counters.nSharedLockWaitNs);
 
-    if ( ppClient == m_Clients.end() ) return false;
+    // waits only for the reads of this client already started
+    pClient->Deactivate( m_Frames );
 
-    m_ClientsIdsBag.push_front( ppClient->first ); // возвращаем значок
+    m_nClientsCount--;
 
-    m_Clients.erase( ppClient );
+    m_ClientsIds.Release( _nClientID ); // возвращаем значок
 
+    // interrupt the client waiting for a frame
+    UnparkClient( *pClient );
+
+    pClient->Wake();
+
+    // the producer may wait for this client: it counts itself first and checks the clients second,
+    // so either it sees the client gone or we see it waiting
+    if ( m_nPutWaiters.load() == 0 ) return true;
+
+    if ( m_eMode == MODE_SINGLE_PRODUCER )
+    {
+        std::lock_guard<std::mutex> wait_locker(m_WaitMutex);
+
+        m_NoSlowClients.Notify();
+    }
+    else
+    {
+        // the producer checks and starts waiting under the exclusive lock, the shared one we hold is enough to not slip in between
+        m_NoSlowClients.Notify();
+    }
     return true;
 }
 
-// Перечисление клиентов, для каждого клиента возвращаем его идентификатор и количество буферов в очереди (задержку) для этого клиента.
 bool    ISplitter::SplitterClientGetCount(OUT int* _pnCount)
 {
-    TReadLock read_locker(m_Mutex);
+    TReadLock read_locker(m_Mutex, std::defer_lock);
+
+    LockCounted(read_locker, m_Counters.nSharedLockWaits, m_Counters.nSharedLockWaitNs);
 
     LOG(DEBUG);
 
     if ( m_bIsClosed ) return false;
 
-    *_pnCount  = m_Clients.size();
+    *_pnCount  = m_nClientsCount;
 
     return true;
 }
 
 bool    ISplitter::SplitterClientGetByIndex(IN int _nIndex, OUT int* _pnClientID, OUT int* _pnLatency)
 {
-    TReadLock read_locker(m_Mutex);
+    // the ids bitmap only changes under the registry lock
+    std::lock_guard<std::mutex> clients_locker(m_ClientsMutex);
+
+    TReadLock read_locker(m_Mutex, std::defer_lock);
+
+    LockCounted(read_locker, m_Counters.nSharedLockWaits, m_Counters.nSharedLockWaitNs);
 
     LOG(DEBUG);
 
     if ( m_bIsClosed ) return false;
 
-    if (_nIndex >= m_Clients.size()) return false;
+    int id = m_ClientsIds.Nth( _nIndex );
 
-    auto ppClient = m_Clients.begin();
+    if ( id == 0 ) return false;
 
-    std::advance(ppClient, _nIndex);
+    auto& client = m_Clients[id - 1];
 
-    auto& [nClientId, pClient] = *ppClient;
-
-    *_pnClientID = nClientId;
+    *_pnClientID = id;
 
-    *_pnLatency = std::distance( pClient->NextFrame(), m_Frames.end() );
+    *_pnLatency = m_Frames.End() - std::max( client.NextFrame(), m_Frames.Begin() );
 
     return true;
 }
 
-// Закрытие объекта сплиттера - все ожидания должны быть прерваны все вызовы возвращают соответствующую ошибку.
-void    ISplitter::SplitterClose()
+// Перечисление всех клиентов за один проход: заполняем не более _nSize элементов массива _pInfo, в _pnCount возвращаем общее количество клиентов.
+bool    ISplitter::SplitterClientsSnapshot(OUT TSplitterClientInfo* _pInfo, IN int _nSize, OUT int* _pnCount)
 {
-    TWriteLock write_locker(m_Mutex);
+    // the ids bitmap only changes under the registry lock
+    std::lock_guard<std::mutex> clients_locker(m_ClientsMutex);
+
+    TReadLock read_locker(m_Mutex, std::defer_lock);
+
+    LockCounted(read_locker, m_Counters.nSharedLockWaits, m_Counters.nSharedLockWaitNs);
 
     LOG(DEBUG);
 
-    m_bIsClosed = true;
+    if ( m_bIsClosed ) return false;
+
+    *_pnCount = m_nClientsCount;
+
+    int nIndex = 0;
+
+    // taken ids only: the cost follows the clients, not the table size
+    for (int id = m_ClientsIds.Next( 0 ); id != 0 && nIndex < _nSize; id = m_ClientsIds.Next( id ))
+    {
+        auto& client = m_Clients[id - 1];
 
-    m_NewFrameUploaded.notify_all();
-    m_NoSlowClients.notify_all();
+        auto& info = _pInfo[nIndex++];
+
+        auto nNextFrame = std::max( client.NextFrame(), m_Frames.Begin() );
+
+        info.nClientID = client.Id();
+        info.nLatency = m_Frames.End() - nNextFrame;
+        info.nLatencyBytes = m_Frames.Bytes( nNextFrame );
+        info.nDropped = client.Dropped( m_Frames );
+    }
+    return true;
+}
+
+// Гистограмма времени от помещения кадров в очередь до выдачи их клиенту _nClientID, с _bReset - забираем её, обнуляя. Обнуляется и при добавлении клиента.
+bool    ISplitter::SplitterClientLatencyGet(IN int _nClientID, OUT TSplitterLatency* _pLatency, IN bool _bReset)
+{
+    if ( m_bIsClosed ) return false;
+
+    auto pClient = FindClient(_nClientID);
+
+    if ( pClient == nullptr ) return false;
+
+    pClient->Latency().Take( *_pLatency, _bReset );
+
+    return true;
 }
 
-std::list<int> ISplitter::SlowClients()
+// Счётчики работы сплиттера с момента создания, суммы по всем клиентам, включая удалённых. Ожидание блокировки сплиттера учитывается, только если она оказалась занята, в MODE_SINGLE_PRODUCER монопольная блокировка - блокировка кладущей стороны. Можно вызывать и после закрытия.
+bool    ISplitter::SplitterStatsGet(OUT TSplitterStats* _pStats)
 {
-    std::list<int> slowClients;
+    if ( _pStats == nullptr ) return false;
+
+    *_pStats = TSplitterStats();
 
-    for( auto&& [nClientId, pClient] : m_Clients)
+    m_Counters.AddTo( *_pStats );
+
+    // the table never changes after construction
+    for (auto& client : m_Clients)
     {
-        if ( pClient->NextFrame()  == m_Frames.begin() )
-        {
-            slowClients.push_back( nClientId );
-        }
+        client.Counters().AddTo( *_pStats );
+    }
+    return true;
+}
+
+// Как ждут SplitterGet и SplitterPut: спят (WAIT_BLOCK, по умолчанию), крутятся до конца срока (WAIT_SPIN, WAIT_YIELD) или крутятся _nSpinUsec микросекунд, а потом спят (WAIT_ADAPTIVE, 0 - сколько стоит заснуть и проснуться на этой машине). Можно менять на ходу, действует на следующие ожидания.
+bool    ISplitter::SplitterWaitStrategySet(IN WaitStrategy _eWait, IN int _nSpinUsec)
+{
+    if ( m_bIsClosed ) return false;
+
+    // the park cost is measured once per process and only if someone needs it
+    if ( _eWait == WAIT_ADAPTIVE )
+    {
+        m_nSpinNs.store( _nSpinUsec > 0 ? _nSpinUsec*1000ull : SplitterParkCostNs(), std::memory_order_relaxed );
     }
-    return slowClients;
+
+    m_eWait.store( _eWait, std::memory_order_relaxed );
+
+    return true;
+}
+
+// Асинхронный SplitterGet: _Done вызывается на исполнителе сплиттера, когда у клиента есть кадр, истекло _nTimeOutMsec (меньше нуля - без ограничения) или ожидание прервано. На время ожидания поток не занимается. У клиента одновременно одно асинхронное ожидание.
+struct ISplitter::TAsyncGet
+{
+    int nClientID{0};
+    uint64_t nGeneration{0};
+    bool bForever{false};
+    TDeadline Deadline;
+    TSplitterExecutor Executor;
+    TSplitterGetCallback Done;
+};
+
+void    ISplitter::SplitterGetAsync(IN int _nClientID, IN int _nTimeOutMsec, IN TSplitterGetCallback _Done)
+{
+    StartAsyncGet( _nClientID, _nTimeOutMsec, nullptr, std::move( _Done ) );
+}
+
+void    ISplitter::StartAsyncGet(int _nClientID, int _nTimeOutMsec, TSplitterExecutor _Executor, TSplitterGetCallback _Done)
+{
+    auto pGet = std::make_shared<TAsyncGet>();
+
+    auto pClient = FindClient(_nClientID);
+
+    pGet->nClientID = _nClientID;
+    pGet->nGeneration = pClient ? pClient->Generation() : 0;
+    pGet->bForever = _nTimeOutMsec < 0;
+    pGet->Deadline = std::chrono::steady_clock::now() + std::max( _nTimeOutMsec, 0 )*1ms;
+    pGet->Executor = std::move( _Executor );
+    pGet->Done = std::move( _Done );
+
+    // _Done never runs on the calling thread
+    Post( [this, pGet] { AsyncGetStep( pGet ); }, pGet->Executor );
+}
+
+// Исполнитель, на котором вызываются SplitterGetAsync и продолжаются корутины. По умолчанию - собственный поток сплиттера, создаваемый при первом асинхронном вызове. Задаём до первого асинхронного вызова, исполнитель должен пережить сплиттер.
+void    ISplitter::SplitterExecutorSet(IN TSplitterExecutor _Executor)
+{
+    std::lock_guard<std::mutex> locker(m_AsyncMutex);
+
+    m_Executor = std::move( _Executor );
+}
+
+// co_await Get(id, timeout) - SplitterGetAsync для корутин C++20
+TSplitterGetAwaiter    ISplitter::Get(IN int _nClientID, IN int _nTimeOutMsec)
+{
+    return TSplitterGetAwaiter( *this, _nClientID, _nTimeOutMsec );
+}
+
+// Асинхронный поток кадров клиента для корутин: while ( auto pFrame = co_await stream.Next() )
+ISplitterStream    ISplitter::Stream(IN int _nClientID)
+{
+    return ISplitterStream( *this, _nClientID );
+}
+
+struct ISplitter::TSubscription
+{
+    int nClientID{0};
+    TSplitterExecutor Executor;
+    TSplitterFrameCallback OnFrame;
+};
+
+// Подписка: добавляем клиента и вызываем _OnFrame для каждого его кадра по порядку, без цикла SplitterGet. Вызовы одного клиента не пересекаются, но могут идти на разных потоках исполнителя _Executor; пустой _Executor - общий пул потоков доставки сплиттера (по потоку на ядро). Пока _OnFrame не вернул управление, клиент стоит на кадре, и медленный обработчик - такой же медленный клиент для SplitterPut. Подписка заканчивается с SplitterClientRemove(*_pnClientID) или закрытием сплиттера, начатый вызов _OnFrame при этом может ещё завершаться. Свой _Executor должен работать, пока сплиттер не закрыт и не выполнены поставленные в него задачи.
+bool    ISplitter::SplitterSubscribe(IN TSplitterFrameCallback _OnFrame, IN TSplitterExecutor _Executor, OUT int* _pnClientID)
+{
+    if ( not SplitterClientAdd( _pnClientID ) ) return false;
+
+    auto pSubscription = std::make_shared<TSubscription>();
+
+    pSubscription->nClientID = *_pnClientID;
+    pSubscription->Executor = _Executor ? std::move( _Executor ) : Dispatcher();
+    pSubscription->OnFrame = std::move( _OnFrame );
+
+    SubscriptionNext( pSubscription );
+
+    return true;
+}
+
+// One asynchronous get at a time per subscription keeps its frames in order whichever thread runs them
+void    ISplitter::SubscriptionNext(const std::shared_ptr<TSubscription>& _pSubscription)
+{
+    StartAsyncGet( _pSubscription->nClientID, -1, _pSubscription->Executor, [this, _pSubscription] (TSplitterGetResult _Result) {
+        // removed, reused by another client or closed: the subscription is over
+        if ( _Result.nError != NO_ERROR ) return;
+
+        _pSubscription->OnFrame( _Result.pFrame, _Result.nSkipped );
+
+        SubscriptionNext( _pSubscription );
+    });
+}
+
+void    ISplitter::AsyncGetStep(const std::shared_ptr<TAsyncGet>& _pGet)
+{
+    TSplitterGetResult result;
+
+    auto pClient = FindClient(_pGet->nClientID);
+
+    // the id was given to another client meanwhile
+    if ( pClient != nullptr && pClient->Generation() != _pGet->nGeneration )
+    {
+        result.nError = ERR_BAD_CLIENT_ID;
+
+        _pGet->Done( std::move( result ) );
+        return;
+    }
+
+    // a client with nothing to read is not even asked: that would count as a timeout in the stats
+    if ( m_bIsClosed || pClient == nullptr || pClient->NextFrame() < m_Frames.End() )
+    {
+        result.nError = SplitterGet( _pGet->nClientID, result.pFrame, 0, &result.nSkipped );
+
+        if ( result.nError != ERR_TIMEOUT )
+        {
+            _pGet->Done( std::move( result ) );
+            return;
+        }
+    }
+
+    if ( not _pGet->bForever && std::chrono::steady_clock::now() >= _pGet->Deadline )
+    {
+        result.nError = ERR_TIMEOUT;
+
+        _pGet->Done( std::move( result ) );
+        return;
+    }
+
+    uint64_t nToken = ++m_nAsyncTokens;
+
+    // woken from SplitterPut, maybe under the splitter lock: only hand the next step to the executor
+    pClient->SetAsyncWake( nToken, [this, _pGet] { Post( [this, _pGet] { AsyncGetStep( _pGet ); }, _pGet->Executor ); } );
+
+    // parked first, checked second: a frame put meanwhile either is seen here or wakes the client
+    ParkClient( *pClient );
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if ( m_bIsClosed || not pClient->Active() || pClient->NextFrame() < m_Frames.End() )
+    {
+        if ( pClient->CancelAsyncWake( nToken ) )
+        {
+            UnparkClient( *pClient );
+
+            Post( [this, _pGet] { AsyncGetStep( _pGet ); }, _pGet->Executor );
+        }
+        return;
+    }
+
+    if ( _pGet->bForever ) return;
+
+    Timer().At( _pGet->Deadline, [this, _pGet, pClient, nToken] {
+        if ( not pClient->CancelAsyncWake( nToken ) ) return;
+
+        UnparkClient( *pClient );
+
+        Post( [this, _pGet] { AsyncGetStep( _pGet ); }, _pGet->Executor );
+    });
+}
+
+void    ISplitter::Post(std::function<void()> _Task, const TSplitterExecutor& _Executor)
+{
+    if ( _Executor )
+    {
+        _Executor( std::move( _Task ) );
+        return;
+    }
+
+    TSplitterExecutor Executor;
+
+    {
+        std::lock_guard<std::mutex> locker(m_AsyncMutex);
+
+        if ( not m_Executor )
+        {
+            m_pExecutorPool = std::make_unique<ISplitterThreadPool>( 1 );
+
+            m_Executor = m_pExecutorPool->Executor();
+        }
+        Executor = m_Executor;
+    }
+
+    Executor( std::move( _Task ) );
+}
+
+TSplitterExecutor ISplitter::Dispatcher()
+{
+    std::lock_guard<std::mutex> locker(m_AsyncMutex);
+
+    if ( not m_pDispatcher ) m_pDispatcher = std::make_unique<ISplitterThreadPool>( std::thread::hardware_concurrency() );
+
+    return m_pDispatcher->Executor();
+}
+
+ISplitterTimer& ISplitter::Timer()
+{
+    std::lock_guard<std::mutex> locker(m_AsyncMutex);
+
+    if ( not m_pTimer ) m_pTimer = std::make_unique<ISplitterTimer>();
+
+    return *m_pTimer;
+}
+
+// Файловый дескриптор (eventfd) клиента для epoll/poll: читаемый, пока у клиента есть непрочитанные кадры, а также после удаления клиента или закрытия сплиттера. Серия SplitterPut делает его читаемым одной записью. Дескриптор принадлежит сплиттеру, закрывать его нельзя, вычитывать не нужно: это делают SplitterGet и SplitterGetBatch, забравшие последний кадр. Для edge-triggered epoll забираем кадры, пока SplitterGet с нулевым ожиданием не вернёт ERR_TIMEOUT.
+bool    ISplitter::SplitterClientGetFd(IN int _nClientID, OUT int* _pnFd)
+{
+    if ( m_bIsClosed ) return false;
+
+    auto pClient = FindClient(_nClientID);
+
+    if ( pClient == nullptr ) return false;
+
+    bool bCreated = not pClient->HasEventFd();
+
+    *_pnFd = pClient->EventFd();
+
+    if ( *_pnFd < 0 ) return false;
+
+    if ( bCreated )
+    {
+        if ( pClient->NextFrame() < m_Frames.End() ) pClient->SignalEventFd();
+
+        ArmClientFd( _nClientID );
+    }
+    return true;
+}
+
+// Закрытие объекта сплиттера - все ожидания должны быть прерваны все вызовы возвращают соответствующую ошибку.
+void    ISplitter::SplitterClose()
+{
+    TWriteLock write_locker(m_Mutex, std::defer_lock);
+
+    LockCounted(write_locker, m_Counters.nExclusiveLockWaits, m_Counters.nExclusiveLockWaitNs);
+
+    LOG(DEBUG);
+
+    m_bIsClosed = true;
+
+    WakeParkedClients();
+
+    m_NoSlowClients.Notify();
+
+    if ( m_eMode == MODE_SINGLE_PRODUCER )
+    {
+        std::lock_guard<std::mutex> wait_locker(m_WaitMutex);
+
+        m_NoSlowClients.Notify();
+    }
+}
+
+void    ISplitter::ParkClient(ISplitterClient& _Client)
+{
+    const std::lock_guard<std::mutex> locker(m_ParkedMutex);
+
+    if ( _Client.m_bParked ) return;
+
+    // a wakeup nobody waited for (e.g. of an eventfd client) must not end the next wait early
+    _Client.ResetWoken();
+
+    _Client.m_bParked = true;
+
+    m_ParkedClients.push_back( &_Client );
+
+    m_nParkedClients.store( m_ParkedClients.size() );
+}
+
+void    ISplitter::UnparkClient(ISplitterClient& _Client)
+{
+    const std::lock_guard<std::mutex> locker(m_ParkedMutex);
+
+    if ( not _Client.m_bParked ) return;
+
+    _Client.m_bParked = false;
+
+    m_ParkedClients.erase( std::find( m_ParkedClients.begin(), m_ParkedClients.end(), &_Client ) );
+
+    m_nParkedClients.store( m_ParkedClients.size() );
+}
+
+void    ISplitter::WakeParkedClients()
+{
+    // the new frame or the closed flag must be visible before we look for waiting clients
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if ( m_nParkedClients.load() == 0 ) return;
+
+    SPLITTER_TRACE( TRACE_WAKE_CLIENTS, m_nParkedClients.load(), 0 );
+
+    std::vector<ISplitterClient*> parked;
+
+    {
+        const std::lock_guard<std::mutex> locker(m_ParkedMutex);
+
+        parked.swap( m_ParkedClients );
+
+        for (auto pClient : parked)
+        {
+            pClient->m_bParked = false;
+        }
+
+        m_nParkedClients.store( 0 );
+    }
+
+    for (auto pClient : parked)
+    {
+        pClient->Wake();
+    }
+}
+
+void    ISplitter::ArmClientFd(int _nClientID)
+{
+    auto pClient = FindClient(_nClientID);
+
+    if ( pClient == nullptr ) return;
+
+    if ( not pClient->HasEventFd() || pClient->NextFrame() < m_Frames.End() ) return;
+
+    pClient->DrainEventFd();
+
+    // parked first, checked second: a frame put meanwhile either is seen here or wakes the client
+    ParkClient( *pClient );
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if ( m_bIsClosed || not pClient->Active() || pClient->NextFrame() < m_Frames.End() )
+    {
+        UnparkClient( *pClient );
+
+        pClient->SignalEventFd();
+    }
+}
+
+bool    ISplitter::HasSlowClients()
+{
+    return SplitterHasSlowClients( m_Frames );
+}
+
+bool    ISplitter::Overflowed()
+{
+    return m_Limits.Overflowed( m_Frames );
+}
+
+bool    ISplitter::NoRoomFor(const TFramePtr& _pFrame)
+{
+    return m_Limits.NoRoomFor( m_Frames, _pFrame );
+}
+
+bool    ISplitter::MustWaitFor(const TFramePtr& _pFrame)
+{
+    return m_eOverflow == OVERFLOW_BLOCK && NoRoomFor( _pFrame ) && HasSlowClients();
+}
+
+bool    ISplitter::DropNewFrame()
+{
+    if ( not HasSlowClients() ) return false;
+
+    // skipped by every client at once, counted once
+    m_Frames.SkipFrame();
+
+    return true;
+}
+
+TSplitterCounters& ISplitter::ClientCounters(int _nClientID)
+{
+    if ( _nClientID > m_nMaxClients || _nClientID < 1 ) return m_Counters;
+
+    return m_Clients[_nClientID - 1].Counters();
+}
+
+template <class TReady>
+bool    ISplitter::Spin(TDeadline _Deadline, TReady _Ready)
+{
+    switch ( m_eWait.load( std::memory_order_relaxed ) )
+    {
+    case WAIT_SPIN:
+        return SplitterSpinUntil( _Deadline, false, _Ready );
+
+    case WAIT_YIELD:
+        return SplitterSpinUntil( _Deadline, true, _Ready );
+
+    case WAIT_ADAPTIVE:
+        return SplitterSpinUntil( std::min( _Deadline, std::chrono::steady_clock::now() + std::chrono::nanoseconds( m_nSpinNs.load( std::memory_order_relaxed ) ) ), false, _Ready );
+
+    default:
+        return false;
+    }
+}
+
+bool    ISplitter::MayPark()
+{
+    auto eWait = m_eWait.load( std::memory_order_relaxed );
+
+    return eWait == WAIT_BLOCK || eWait == WAIT_ADAPTIVE;
+}
+
+template <class TLocker>
+void    ISplitter::LockCounted(TLocker& _Locker, std::atomic<uint64_t>& _nWaits, std::atomic<uint64_t>& _nWaitNs)
+{
+    if ( _Locker.try_lock() ) return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    _Locker.lock();
+
+    TSplitterCounters::Add( _nWaits, 1 );
+    TSplitterCounters::Add( _nWaitNs, ElapsedNs( start ) );
+}
+
+ISplitterClient* ISplitter::FindClient(int _nClientID)
+{
+    if ( _nClientID > m_nMaxClients || _nClientID < 1 ) return nullptr;
+
+    auto& client = m_Clients[_nClientID - 1];
+
+    if ( not client.Active() ) return nullptr;
+
+    return &client;
+}
+
+// MODE_SINGLE_PRODUCER
+//
+// Clients take frames with a CAS on their own position and never touch m_Mutex. The producer only
+// waits on m_WaitMutex when a client holds the oldest frame, and only wakes the other side when
+// somebody announced waiting: both sides first touch their waiters counter and then check the
+// condition, so at least one of them sees the other.
+
+int    ISplitter::SingleProducerPut(const TFramePtr* _pFrames, int _nFrames, TDeadline _Deadline, bool _bTry)
+{
+    std::unique_lock<std::mutex> put_locker(m_PutMutex, std::defer_lock);
+
+    LockCounted(put_locker, m_Counters.nExclusiveLockWaits, m_Counters.nExclusiveLockWaitNs);
+
+    if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+
+    if ( _bTry && MustWaitFor( *_pFrames ) ) return ERR_TIMEOUT;
+
+    int res = 0;
+
+    while ( _nFrames > 0 )
+    {
+        uint64_t nPublishNs = SplitterNowNs();
+
+        // the ring never grows here: clients read it concurrently
+        do
+        {
+            if ( m_eOverflow == OVERFLOW_DROP_NEWEST && NoRoomFor( *_pFrames ) && DropNewFrame() )
+            {
+                SPLITTER_TRACE( TRACE_DROP_NEW, m_Frames.End(), 0 );
+
+                TSplitterCounters::Add( m_Counters.nForcedRemovals, 1 );
+
+                _pFrames++;
+
+                res = ERR_FORCED_FRAMES_REMOVE;
+
+                continue;
+            }
+
+            SPLITTER_TRACE( TRACE_PUT, m_Frames.End(), *_pFrames ? (*_pFrames)->size() : 0 );
+
+            TSplitterCounters::Add( m_Counters.nFramesPut, 1 );
+
+            m_Frames.push_back(*_pFrames++, nPublishNs);
+        }
+        while ( --_nFrames > 0 && not Overflowed() );
+
+        WakeParkedClients();
+
+        ReleaseConsumedFrames();
+
+        while ( Overflowed() )
+        {
+            int nRes = SingleProducerRemoveOldest( _Deadline );
+
+            if ( nRes == ERR_SPLITTER_IS_CLOSED ) return nRes;
+
+            if ( nRes != 0 ) res = nRes;
+        }
+    }
+    return res;
+}
+
+int    ISplitter::SingleProducerRemoveOldest(TDeadline _Deadline)
+{
+    // wait for slow
+
+    if ( m_eOverflow == OVERFLOW_BLOCK && HasSlowClients() )
+    {
+        SPLITTER_TRACE( TRACE_WAIT_SLOW, m_Frames.Begin(), 0 );
+
+        m_nPutWaiters.fetch_add(1);
+
+        auto start = std::chrono::steady_clock::now();
+
+        auto NoSlowClients = [this] { return m_bIsClosed || not HasSlowClients(); };
+
+        if ( not Spin( _Deadline, NoSlowClients ) && MayPark() )
+        {
+            std::unique_lock<std::mutex> wait_locker(m_WaitMutex);
+
+            m_NoSlowClients.Wait(wait_locker, _Deadline, NoSlowClients);
+        }
+
+        TSplitterCounters::Add( m_Counters.nSlowClientsWaitNs, ElapsedNs( start ) );
+
+        m_nPutWaiters.fetch_sub(1);
+
+        if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+    }
+
+    // remove last frame
+
+    TFrameSeq nOldest = m_Frames.Begin();
+
+    int res = 0;
+
+    uint64_t nForced = 0;
+
+    // a free oldest frame goes without a pass over the clients; a taken one costs a pass: lock-free readers
+    // may be inside it, so each cursor is moved by its own FrameIncrement, unlike the carry of the shared mode.
+    // Only the connected clients are visited: their ids are read under the registry lock, which adding and
+    // removing clients hold without ever waiting for the producer
+    if ( m_Frames.ClientsAt( nOldest ) > 0 )
+    {
+        std::lock_guard<std::mutex> clients_locker(m_ClientsMutex);
+
+        for (int id = m_ClientsIds.Next( 0 ); id != 0; id = m_ClientsIds.Next( id ))
+        {
+            if ( m_Clients[id - 1].FrameIncrement( m_Frames, nOldest ) ) nForced++;
+        }
+    }
+
+    if ( nForced > 0 )
+    {
+        TSplitterCounters::Add( m_Counters.nForcedRemovals, 1 );
+
+        res = ERR_FORCED_FRAMES_REMOVE;
+    }
+
+    SPLITTER_TRACE( TRACE_REMOVE_OLDEST, nOldest, nForced );
+
+    m_Frames.pop_front();
+
+    return res;
+}
+
+int    ISplitter::SingleProducerGet(ISplitterClient& _Client, uint64_t _nGeneration, TFramePtr* _pFrames, int _nMaxFrames, int* _pnFrames, TDeadline _Deadline)
+{
+    TFrameSeq nFrame = 0;
+
+    auto& counters = _Client.Counters();
+
+    *_pnFrames = _Client.PopFrames( m_Frames, _pFrames, _nMaxFrames, _nGeneration, &nFrame );
+
+    if ( *_pnFrames == 0 )
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        while ( true )
+        {
+            if ( start >= _Deadline )
+            {
+                TSplitterCounters::Add( counters.nTimeouts, 1 );
+
+                return ERR_TIMEOUT;
+            }
+
+            SPLITTER_TRACE( TRACE_WAIT_FRAME, _Client.Id(), _Client.NextFrame() );
+
+            auto Ready = [&] { return m_bIsClosed || not _Client.Active( _nGeneration ) || _Client.NextFrame() < m_Frames.End(); };
+
+            bool bWoken = Spin( _Deadline, Ready );
+
+            if ( not bWoken && MayPark() )
+            {
+                ParkClient( _Client );
+
+                // parked first, checked second: a frame put meanwhile either is seen here or wakes us
+                bWoken = Ready() || _Client.Wait( _Deadline );
+
+                UnparkClient( _Client );
+            }
+
+            TSplitterCounters::Add( counters.nNewFrameWaitNs, ElapsedNs( start ) );
+
+            start = std::chrono::steady_clock::now();
+
+            if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+
+            if ( not _Client.Active( _nGeneration ) ) return ERR_BAD_CLIENT_ID;
+
+            *_pnFrames = _Client.PopFrames( m_Frames, _pFrames, _nMaxFrames, _nGeneration, &nFrame );
+
+            if ( *_pnFrames > 0 ) break;
+
+            // woken without a frame: wait on till the deadline
+            if ( bWoken ) TSplitterCounters::Add( counters.nSpuriousWakeups, 1 );
+        }
+    }
+
+    TSplitterCounters::Add( counters.nFramesGot, *_pnFrames );
+
+    SPLITTER_TRACE( TRACE_GET, _Client.Id(), m_Frames.End() - std::max( _Client.NextFrame(), m_Frames.Begin() ) );
+
+    // the frames behind everybody go with the put lock: a producer holding it releases them itself
+    // at the end of its put, and a get racing that end leaves them to the next put or get
+    if ( nFrame == m_Frames.Begin() && not HasSlowClients() )
+    {
+        std::unique_lock<std::mutex> put_locker(m_PutMutex, std::try_to_lock);
+
+        if ( put_locker ) ReleaseConsumedFrames();
+    }
+
+    // only the client leaving the oldest frame may release the waiting producer,
+    // which does not move the oldest frame while it waits
+    if ( m_nPutWaiters.load() > 0 && nFrame == m_Frames.Begin() )
+    {
+        SPLITTER_TRACE( TRACE_NOTIFY_PRODUCER, _Client.Id(), nFrame );
+
+        std::lock_guard<std::mutex> wait_locker(m_WaitMutex);
+
+        m_NoSlowClients.Notify();
+    }
+    return 0;
+}
+
+int    ISplitter::SingleProducerFlush()
+{
+    std::unique_lock<std::mutex> put_locker(m_PutMutex, std::defer_lock);
+
+    LockCounted(put_locker, m_Counters.nExclusiveLockWaits, m_Counters.nExclusiveLockWaitNs);
+
+    if ( m_bIsClosed ) return ERR_SPLITTER_IS_CLOSED;
+
+    TReadLock locker(m_Mutex, std::defer_lock);
+
+    LockCounted(locker, m_Counters.nSharedLockWaits, m_Counters.nSharedLockWaitNs);
+
+    // move clients off the frames first, then release them
+    for (auto& client : m_Clients)
+    {
+        client.SetNextFrame( m_Frames, m_Frames.End() );
+    }
+
+    m_Frames.clear();
+
+    return 0;
 }
 
@@ -3,12 +3,22 @@
 
 #include "splitter_definitions.h"
 #include "splitter_client.h"
+#include "splitter_coro.h"
+#include "splitter_executor.h"
+#include "splitter_frame_pool.h"
+#include "splitter_ring.h"
+#include "splitter_wait.h"
 
-#include <condition_variable>
+#include <chrono>
+#include <span>
 
 #define OUT
 #define IN
 
+// Сплиттер, настраиваемый во время выполнения: режим, политика переполнения и ожидание выбираются при
+// создании или на ходу. Очередь (ISplitterRing), правила переполнения (TSplitterLimits) и ожидание
+// медленных клиентов (TSplitterEvent) у него общие с BasicSplitter из splitter_basic.h, который собирается
+// из тех же частей во время компиляции и не платит за shared_mutex, когда блокировка не нужна.
 class ISplitter
 {
     // ISplitter интерфейс
@@ -17,21 +27,88 @@ public:
     enum ErrorCode {
         NO_ERROR=0
         ,ERR_BAD_CLIENT_ID
-        ,ERR_SPOUROIUS_WAKEUP
+        ,ERR_SPOUROIUS_WAKEUP   // больше не возвращается, значение оставлено ради совместимости кодов
         ,ERR_TIMEOUT
         ,ERR_FORCED_FRAMES_REMOVE
         ,ERR_SPLITTER_IS_CLOSED
+        ,ERR_NO_RESERVATION
+        ,ERR_NOT_OWNER          // кадры кладёт только процесс, создавший сплиттер (ISplitterShm)
+        ,ERR_FRAME_TOO_LARGE    // кадр больше ячейки, заданной при создании (ISplitterShm)
+        ,ERR_COMMIT_TOO_LARGE   // SplitterCommit: записано больше, чем зарезервировано
     };
 
-    ISplitter(int _nMaxBuffers, int _nMaxClients);
+    // Режим работы сплиттера
+    enum Mode {
+        // Любое количество потоков кладут и забирают кадры под общей блокировкой
+        MODE_SHARED_LOCK=0
+        // Один поток кладёт кадры, клиенты забирают их без блокировки сплиттера: позиция каждого клиента
+        // в отдельной строке кэша, конец очереди публикуется атомарной записью. SplitterPut и SplitterFlush
+        // должен вызывать один поток.
+        ,MODE_SINGLE_PRODUCER
+    };
+
+    // Что делать, когда очередь переполнена, а самый старый кадр ещё не забрали медленные клиенты
+    enum OverflowPolicy {
+        // Ждём медленных клиентов _nTimeOutMsec, потом удаляем самый старый кадр
+        OVERFLOW_BLOCK=0
+        // Не ждём: сразу удаляем самый старый кадр, его пропускают только отстающие клиенты. В MODE_SHARED_LOCK
+        // цена кадра не зависит от числа клиентов, в MODE_SINGLE_PRODUCER удаление кадра, который ещё не забрали,
+        // обходит подключённых клиентов: на тысячи отстающих клиентов - MODE_SHARED_LOCK или OVERFLOW_DROP_NEWEST
+        ,OVERFLOW_DROP_OLDEST
+        // Не ждём: новый кадр не кладём в очередь, его пропускают все клиенты
+        ,OVERFLOW_DROP_NEWEST
+    };
+
+    // Как ждать кадра в SplitterGet и медленных клиентов в SplitterPut
+    enum WaitStrategy {
+        // Спим, пока не разбудят
+        WAIT_BLOCK=0
+        // Крутимся с паузой процессора до конца срока, не засыпая: для потоков на выделенных ядрах
+        ,WAIT_SPIN
+        // Крутимся, отдавая процессор другим потокам
+        ,WAIT_YIELD
+        // Крутимся недолго, потом спим
+        ,WAIT_ADAPTIVE
+    };
+
+    // _nMaxBytes - ограничение на суммарный размер кадров в очереди, 0 - без ограничения. Переполнение наступает при
+    // превышении любого из ограничений, самый новый кадр остаётся в очереди, даже если он один больше _nMaxBytes.
+    ISplitter(int _nMaxBuffers, int _nMaxClients, Mode _eMode = MODE_SHARED_LOCK, OverflowPolicy _eOverflow = OVERFLOW_BLOCK, uint64_t _nMaxBytes = 0);
 
     ~ISplitter();
 
     bool    SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients);
 
-    // Кладём данные в очередь. Если какой-то клиент не успел ещё забрать свои данные, и количество буферов (задержка) для него больше максимального значения, то ждём пока не освободятся буфера (клиент заберет данные) в течении _nTimeOutMsec. Если по истечению времени данные так и не забраны, то удаляем старые данные для этого клиента, добавляем новые (по принципу FIFO) (*). Возвращаем код ошибки, который дает понять что один или несколько клиентов “пропустили” свои данные.
+    // То же, а также ограничение на размер кадров в очереди (0 - без ограничения) и их текущий размер в байтах.
+    bool    SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients, OUT uint64_t* _pnMaxBytes, OUT uint64_t* _pnRetainedBytes);
+
+    // Момент, до которого ждём, для вызовов с абсолютным сроком ожидания
+    typedef std::chrono::steady_clock::time_point TDeadline;
+
+    // Кладём данные в очередь. Политика OVERFLOW_BLOCK: если какой-то клиент не успел ещё забрать свои данные, и количество буферов (задержка) для него больше максимального значения, то ждём пока не освободятся буфера (клиент заберет данные) в течении _nTimeOutMsec. Если по истечению времени данные так и не забраны, то удаляем старые данные для этого клиента, добавляем новые (по принципу FIFO) (*). Возвращаем код ошибки, который дает понять что один или несколько клиентов “пропустили” свои данные.
     int    SplitterPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut, IN int _nTimeOutMsec);
 
+    // То же, но медленных клиентов ждём до момента _Deadline.
+    int    SplitterPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut, IN TDeadline _Deadline);
+
+    // Кладём кадр, никого не ожидая. При OVERFLOW_BLOCK, если кадр переполнит очередь, а самый старый кадр ещё не забрали медленные клиенты, кадр не кладём и возвращаем ERR_TIMEOUT. При остальных политиках - как SplitterPut.
+    int    SplitterTryPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut);
+
+    // Берём из пула сплиттера кадр размера _nSize, чтобы заполнить его и положить в очередь. Когда пропадает последняя ссылка на кадр, его буфер возвращается в пул, а не освобождается. Содержимое кадра не определено.
+    TFramePtr    SplitterFrameAcquire(IN size_t _nSize);
+
+    // Кладём кадр в очередь, как SplitterPut, и узнаём, когда он больше не нужен: _OnReleased вызывается, когда все клиенты забрали или пропустили кадр и отпустили ссылки на него: забранный всеми кадр сплиттер убирает из очереди сразу, не дожидаясь её переполнения. Ссылки, оставшиеся у вызывающего, не учитываются. _OnReleased может быть вызван под блокировкой сплиттера и не должен обращаться к нему.
+    int    SplitterPut(IN const std::shared_ptr<std::vector<uint8_t>>& _pVecPut, IN TFrameRelease _OnReleased, IN int _nTimeOutMsec);
+
+    // Резервируем в памяти сплиттера буфер под кадр размера _nSize: данные пишем сразу в _Reservation.pData, без промежуточного вектора. Клиенты увидят кадр после SplitterCommit, если резерв просто уничтожить, буфер вернётся в пул.
+    bool    SplitterReserve(IN size_t _nSize, OUT TFrameReservation& _Reservation);
+
+    // Публикуем зарезервированный кадр, как SplitterPut. _nSize - сколько байт реально записано, не больше зарезервированного, иначе возвращаем ERR_COMMIT_TOO_LARGE и резерв не трогаем. Резерв после публикации пуст.
+    int    SplitterCommit(IN TFrameReservation& _Reservation, IN size_t _nSize, IN int _nTimeOutMsec);
+
+    // Кладём в очередь сразу несколько кадров, как SplitterPut, под одной блокировкой и с одним пробуждением клиентов. _nTimeOutMsec - общее время ожидания медленных клиентов на все кадры.
+    int    SplitterPutBatch(IN std::span<const TFramePtr> _Frames, IN int _nTimeOutMsec);
+
     // Сбрасываем все буфера, прерываем все ожидания.
     int    SplitterFlush();
 
@@ -45,27 +122,167 @@ public:
     bool    SplitterClientGetCount(OUT int* _pnCount);
     bool    SplitterClientGetByIndex(IN int _nIndex, OUT int* _pnClientID, OUT int* _pnLatency);
 
+    // Перечисление всех клиентов за один проход: заполняем не более _nSize элементов массива _pInfo, в _pnCount возвращаем общее количество клиентов.
+    bool    SplitterClientsSnapshot(OUT TSplitterClientInfo* _pInfo, IN int _nSize, OUT int* _pnCount);
+
     // По идентификатору клиента запрашиваем данные, если данных пока нет, то ожидаем _nTimeOutMsec пока не будут добавлены новые данные, в случае превышения времени ожидания - возвращаем ошибку.
-    int    SplitterGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, IN int _nTimeOutMsec);
+    // В _pnSkipped возвращаем, сколько кадров клиент пропустил с прошлого успешного вызова. Пробуждение без кадра ожидание не прерывает: ERR_SPOUROIUS_WAKEUP не возвращается.
+    int    SplitterGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped = nullptr);
+
+    // То же, но кадр ждём до момента _Deadline.
+    int    SplitterGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, IN TDeadline _Deadline, OUT uint64_t* _pnSkipped = nullptr);
+
+    // Забираем кадр, если он уже есть, иначе сразу возвращаем ERR_TIMEOUT, не ожидая.
+    int    SplitterTryGet(IN int _nClientID, OUT std::shared_ptr<std::vector<uint8_t>>& _pVecGet, OUT uint64_t* _pnSkipped = nullptr);
+
+    // Забираем сразу все накопившиеся для клиента кадры, но не больше, чем помещается в _Frames, в _pnFrames - сколько забрали. Ждём, как SplitterGet, только если кадров нет совсем. В пустой _Frames забрать нечего: сразу ERR_TIMEOUT.
+    int    SplitterGetBatch(IN int _nClientID, OUT std::span<TFramePtr> _Frames, OUT int* _pnFrames, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped = nullptr);
+
+    // Гистограмма времени от помещения кадров в очередь до выдачи их клиенту _nClientID, с _bReset - забираем её, обнуляя. Обнуляется и при добавлении клиента.
+    bool    SplitterClientLatencyGet(IN int _nClientID, OUT TSplitterLatency* _pLatency, IN bool _bReset = false);
+
+    // Счётчики работы сплиттера с момента создания, суммы по всем клиентам, включая удалённых. Ожидание блокировки сплиттера учитывается, только если она оказалась занята, в MODE_SINGLE_PRODUCER монопольная блокировка - блокировка кладущей стороны. Можно вызывать и после закрытия.
+    bool    SplitterStatsGet(OUT TSplitterStats* _pStats);
+
+    // Как ждут SplitterGet и SplitterPut: спят (WAIT_BLOCK, по умолчанию), крутятся до конца срока (WAIT_SPIN, WAIT_YIELD) или крутятся _nSpinUsec микросекунд, а потом спят (WAIT_ADAPTIVE, 0 - сколько стоит заснуть и проснуться на этой машине). Можно менять на ходу, действует на следующие ожидания.
+    bool    SplitterWaitStrategySet(IN WaitStrategy _eWait, IN int _nSpinUsec = 0);
+
+    // Асинхронный SplitterGet: _Done вызывается на исполнителе сплиттера, когда у клиента есть кадр, истекло _nTimeOutMsec (меньше нуля - без ограничения) или ожидание прервано. На время ожидания поток не занимается. У клиента одновременно одно асинхронное ожидание.
+    void    SplitterGetAsync(IN int _nClientID, IN int _nTimeOutMsec, IN TSplitterGetCallback _Done);
+
+    // Исполнитель, на котором вызываются SplitterGetAsync и продолжаются корутины. По умолчанию - собственный поток сплиттера, создаваемый при первом асинхронном вызове. Задаём до первого асинхронного вызова, исполнитель должен пережить сплиттер.
+    void    SplitterExecutorSet(IN TSplitterExecutor _Executor);
+
+    // Подписка: добавляем клиента и вызываем _OnFrame для каждого его кадра по порядку, без цикла SplitterGet. Вызовы одного клиента не пересекаются, но могут идти на разных потоках исполнителя _Executor; пустой _Executor - общий пул потоков доставки сплиттера (по потоку на ядро). Пока _OnFrame не вернул управление, клиент стоит на кадре, и медленный обработчик - такой же медленный клиент для SplitterPut. Подписка заканчивается с SplitterClientRemove(*_pnClientID) или закрытием сплиттера, начатый вызов _OnFrame при этом может ещё завершаться. Свой _Executor должен работать, пока сплиттер не закрыт и не выполнены поставленные в него задачи.
+    bool    SplitterSubscribe(IN TSplitterFrameCallback _OnFrame, IN TSplitterExecutor _Executor, OUT int* _pnClientID);
+
+    // co_await Get(id, timeout) - SplitterGetAsync для корутин C++20
+    TSplitterGetAwaiter    Get(IN int _nClientID, IN int _nTimeOutMsec);
+
+    // Асинхронный поток кадров клиента для корутин: while ( auto pFrame = co_await stream.Next() )
+    ISplitterStream    Stream(IN int _nClientID);
+
+    // Файловый дескриптор (eventfd) клиента для epoll/poll: читаемый, пока у клиента есть непрочитанные кадры, а также после удаления клиента или закрытия сплиттера. Серия SplitterPut делает его читаемым одной записью. Дескриптор принадлежит сплиттеру, закрывать его нельзя, вычитывать не нужно: это делают SplitterGet и SplitterGetBatch, забравшие последний кадр. Для edge-triggered epoll забираем кадры, пока SplitterGet с нулевым ожиданием не вернёт ERR_TIMEOUT.
+    bool    SplitterClientGetFd(IN int _nClientID, OUT int* _pnFd);
 
     // Закрытие объекта сплиттера - все ожидания должны быть прерваны все вызовы возвращают соответствующую ошибку.
     void    SplitterClose();
 
 private:
 
-    std::list<int> SlowClients();
+    bool    HasSlowClients();
+
+    // _bTry: кадр, которому пришлось бы ждать медленных клиентов, не кладём
+    int     PutFrames(const TFramePtr* _pFrames, int _nFrames, TDeadline _Deadline, bool _bTry = false);
+    int     RemoveOldestFrame(TWriteLock& _Locker, TDeadline _Deadline);
+
+    // Убираем из очереди самые старые кадры, которые все клиенты уже забрали или пропустили: их больше никто
+    // не прочтёт, новые клиенты начинают с конца очереди. Очередь при этом меняет только вызывающий поток.
+    void    ReleaseConsumedFrames();
+    int     GetFrames(int _nClientID, TFramePtr* _pFrames, int _nMaxFrames, int* _pnFrames, TDeadline _Deadline, uint64_t* _pnSkipped);
+
+    // В очереди больше кадров или байт, чем можно
+    bool    Overflowed();
+
+    // Кадр _pFrame переполнит очередь
+    bool    NoRoomFor(const TFramePtr& _pFrame);
+
+    // OVERFLOW_BLOCK: кадру _pFrame придётся ждать медленных клиентов
+    bool    MustWaitFor(const TFramePtr& _pFrame);
+
+    // OVERFLOW_DROP_NEWEST: новый кадр не помещается, потому что самый старый ещё нужен
+    bool    DropNewFrame();
+
+    // MODE_SINGLE_PRODUCER
+    int     SingleProducerPut(const TFramePtr* _pFrames, int _nFrames, TDeadline _Deadline, bool _bTry);
+    int     SingleProducerRemoveOldest(TDeadline _Deadline);
+    int     SingleProducerGet(ISplitterClient& _Client, uint64_t _nGeneration, TFramePtr* _pFrames, int _nMaxFrames, int* _pnFrames, TDeadline _Deadline);
+    int     SingleProducerFlush();
+
+    ISplitterClient* FindClient(int _nClientID);
+
+    // Счётчики клиента, даже неактивного, или общие, если идентификатор неверный
+    TSplitterCounters& ClientCounters(int _nClientID);
+
+    // Ждём _Ready(), не засыпая, как велит стратегия ожидания. false - условие не выполнилось:
+    // пора спать, если MayPark(), иначе срок уже вышел.
+    template <class TReady>
+    bool    Spin(TDeadline _Deadline, TReady _Ready);
+
+    bool    MayPark();
 
-    bool m_bIsClosed{true};
+    // Берём блокировку, время ожидания считаем, только если она занята
+    template <class TLocker>
+    static void LockCounted(TLocker& _Locker, std::atomic<uint64_t>& _nWaits, std::atomic<uint64_t>& _nWaitNs);
+
+    // Клиенты, ждущие новый кадр. Кладущий кадр поток будит только их и только один раз:
+    // разбуженный клиент убирается из списка.
+    void    ParkClient(ISplitterClient& _Client);
+    void    UnparkClient(ISplitterClient& _Client);
+    void    WakeParkedClients();
+
+    // Клиент с eventfd забрал все кадры: сбрасываем дескриптор и ставим клиента в список ждущих,
+    // чтобы следующий кадр снова сделал дескриптор читаемым
+    void    ArmClientFd(int _nClientID);
+
+    // SplitterGetAsync: пробуем забрать кадр, если его нет - оставляем клиенту асинхронное ожидание
+    struct TAsyncGet;
+    void    AsyncGetStep(const std::shared_ptr<TAsyncGet>& _pGet);
+
+    void    StartAsyncGet(int _nClientID, int _nTimeOutMsec, TSplitterExecutor _Executor, TSplitterGetCallback _Done);
+
+    struct TSubscription;
+    void    SubscriptionNext(const std::shared_ptr<TSubscription>& _pSubscription);
+
+    // Задача на исполнитель _Executor, если он пуст - на исполнитель сплиттера
+    void    Post(std::function<void()> _Task, const TSplitterExecutor& _Executor = nullptr);
+    TSplitterExecutor Dispatcher();
+    ISplitterTimer& Timer();
+
+    std::atomic<bool> m_bIsClosed{true};
+    const Mode m_eMode;
+    const OverflowPolicy m_eOverflow;
     TLock m_Mutex;
-    std::condition_variable_any m_NewFrameUploaded;
-    std::condition_variable_any m_NoSlowClients;
+    TSplitterEvent<> m_NoSlowClients;
     TFrameBuf m_Frames;
-    std::map<int, ClientPtr> m_Clients;
-    std::list<int> m_ClientsIdsBag;
-    int m_nMaxBuffers{0};
+    ISplitterClientTable m_Clients; // по идентификатору: m_Clients[id-1]
+
+    // Добавление и удаление клиентов: таблица m_Clients не меняется, клиент только включается и выключается,
+    // поэтому ни кладущий кадры поток, ни клиенты эту блокировку не берут
+    std::mutex m_ClientsMutex;
+    std::atomic<int> m_nClientsCount{0};
+    ISplitterClientIds m_ClientsIds;
+    TSplitterLimits m_Limits;
     int m_nMaxClients{0};
+    std::shared_ptr<ISplitterFramePool> m_pFramePool;
+    std::atomic<WaitStrategy> m_eWait{WAIT_BLOCK};
+    std::atomic<uint64_t> m_nSpinNs{0}; // WAIT_ADAPTIVE
+
+    std::mutex m_ParkedMutex;
+    std::vector<ISplitterClient*> m_ParkedClients;
+    alignas(CACHE_LINE_SIZE) std::atomic<int> m_nParkedClients{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int> m_nPutWaiters{0};
+
+    // MODE_SINGLE_PRODUCER: m_Mutex берут только добавление и удаление клиентов и их перечисление,
+    // поток, кладущий кадры, ждёт медленных клиентов на m_WaitMutex
+    std::mutex m_PutMutex;
+    std::mutex m_WaitMutex;
+
+    // MODE_SHARED_LOCK: забранные кадры убирают клиенты под общей блокировкой, по одному
+    std::mutex m_ReleaseMutex;
+
+    // Асинхронные ожидания: исполнитель, таймер для ограничения ожидания
+    std::mutex m_AsyncMutex;
+    TSplitterExecutor m_Executor;
+    std::unique_ptr<ISplitterThreadPool> m_pExecutorPool;
+    std::unique_ptr<ISplitterThreadPool> m_pDispatcher; // подписки без своего исполнителя
+    std::unique_ptr<ISplitterTimer> m_pTimer;
+    std::atomic<uint64_t> m_nAsyncTokens{0};
+
+    // Счётчики кладущей стороны и служебных вызовов, у клиентов свои
+    alignas(CACHE_LINE_SIZE) TSplitterCounters m_Counters;
 };
 
-std::shared_ptr<ISplitter>    SplitterCreate(IN int _nMaxBuffers, IN int _nMaxClients);
+std::shared_ptr<ISplitter>    SplitterCreate(IN int _nMaxBuffers, IN int _nMaxClients, IN ISplitter::Mode _eMode = ISplitter::MODE_SHARED_LOCK, IN ISplitter::OverflowPolicy _eOverflow = ISplitter::OVERFLOW_BLOCK, IN uint64_t _nMaxBytes = 0);
 
 #endif /*_SPLITTER_H*/
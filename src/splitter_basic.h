@@ -0,0 +1,491 @@
+#ifndef SPLITTER_BASIC_H
+#define SPLITTER_BASIC_H
+
+#include "splitter.h"
+#include "splitter_wait.h"
+
+#include <deque>
+
+// Сплиттер, собранный из стратегий во время компиляции: BasicSplitter<Storage, Wait, Overflow, Lock>.
+// Каждая ось - отдельный тип, ненужное не компилируется: однопоточный конвейер с TNoLock не платит за
+// блокировки, клиент со TSpinWait - за системные вызовы. Коды ошибок - ISplitter::ErrorCode, вызовы - как
+// у ISplitter. Асинхронных ожиданий, подписок, eventfd, счётчиков и MODE_SINGLE_PRODUCER здесь нет - они
+// остаются за ISplitter.
+//
+// Очередь и правила переполнения у них общие, поведение - как у ISplitter в MODE_SHARED_LOCK: кадры
+// хранит ISplitterRing (или хранилище с тем же набором вызовов), медленных клиентов он считает на каждом
+// кадре, ограничения по кадрам и байтам - TSplitterLimits. SplitterPut кладёт кадр сразу, клиенты видят его,
+// не дожидаясь медленных; если очередь переполнена, самый старый кадр удаляется: при TOverflowBlock -
+// когда его заберут медленные клиенты или истечёт срок, при TOverflowDropOldest - сразу. При
+// TOverflowDropNewest новый кадр, которому нет места, не кладётся, его пропускают все клиенты.
+// Удалённые позади клиента кадры он пропускает при следующем SplitterGet, их количество - в _pnSkipped.
+
+// Хранение кадров. Кадр адресуется номером, как в ISplitterRing, он же - хранилище по умолчанию:
+// кольцо, память под которое выделяется один раз.
+
+// Очередь без заранее выделенной памяти: растёт и сжимается вместе с количеством кадров.
+// Вызовы - как у ISplitterRing, менять её можно только под исключительной блокировкой сплиттера.
+class TDequeStorage
+{
+public:
+
+    // клиенты удаляемого кадра всегда переходят на следующий, как ISplitterRing с _bCarryClients
+    TDequeStorage( int, bool ) { m_Clients.emplace_back( 0 ); };
+
+    TFrameSeq Begin() const { return m_nBegin; };
+
+    TFrameSeq End() const { return m_nBegin + m_Frames.size(); };
+
+    size_t size() const { return m_Frames.size(); };
+
+    bool empty() const { return m_Frames.empty(); };
+
+    const TFramePtr& At( TFrameSeq _nSeq ) const { return m_Frames[ _nSeq - m_nBegin ].pFrame; };
+
+    uint64_t Bytes( TFrameSeq _nSeq ) const
+    {
+        if ( _nSeq >= End() ) return 0;
+
+        return m_nBytesTotal - m_Frames[ std::max( _nSeq, m_nBegin ) - m_nBegin ].nBytesBefore;
+    };
+
+    uint64_t RetainedBytes() const { return empty() ? 0 : m_nBytesTotal - m_Frames.front().nBytesBefore; };
+
+    // счётчики клиентов на кадрах [Begin(), End()], клиенты двигают их под разделяемой блокировкой
+    int ClientsAt( TFrameSeq _nSeq ) const { return m_Clients[ _nSeq - m_nBegin ].load(); };
+
+    void ClientEnter( TFrameSeq _nSeq ) { m_Clients[ _nSeq - m_nBegin ].fetch_add( 1 ); };
+
+    void ClientLeave( TFrameSeq _nSeq ) { m_Clients[ std::max( _nSeq, m_nBegin ) - m_nBegin ].fetch_sub( 1 ); };
+
+    void SkipFrame() { m_nSkipped++; };
+
+    uint64_t Skipped() const { return m_nSkipped; };
+
+    void push_back( const TFramePtr& _pFrame, uint64_t = 0 )
+    {
+        m_Frames.push_back( TSlot{ _pFrame, m_nBytesTotal } );
+
+        m_nBytesTotal += _pFrame ? _pFrame->size() : 0;
+
+        m_Clients.emplace_back( 0 );
+    };
+
+    void pop_front()
+    {
+        if ( empty() ) return;
+
+        m_Frames.pop_front();
+
+        int clients = m_Clients.front().load();
+
+        m_Clients.pop_front();
+
+        m_Clients.front().fetch_add( clients );
+
+        m_nBegin++;
+    };
+
+    void clear() { while ( not empty() ) pop_front(); };
+
+private:
+
+    struct TSlot
+    {
+        TFramePtr pFrame;
+        uint64_t nBytesBefore{0};
+    };
+
+    std::deque<TSlot> m_Frames;
+    std::deque<std::atomic<int>> m_Clients; // на кадр больше: End() тоже считается
+    TFrameSeq m_nBegin{0};
+    uint64_t m_nBytesTotal{0};
+    uint64_t m_nSkipped{0};
+};
+
+// Что делать с кадром, которому нет места, пока самый старый кадр нужен медленным клиентам.
+// Политики те же, что ISplitter::OverflowPolicy.
+
+struct TOverflowBlock { static constexpr bool WAITS = true; static constexpr bool DROPS_NEWEST = false; };
+
+struct TOverflowDropOldest { static constexpr bool WAITS = false; static constexpr bool DROPS_NEWEST = false; };
+
+struct TOverflowDropNewest { static constexpr bool WAITS = false; static constexpr bool DROPS_NEWEST = true; };
+
+// Блокировки. Кладущие кадры и меняющие клиентов берут lock(), забирающие кадры - lock_shared().
+
+struct TSharedMutexLock
+{
+    void lock() { m_Mutex.lock(); };
+    void unlock() { m_Mutex.unlock(); };
+    void lock_shared() { m_Mutex.lock_shared(); };
+    void unlock_shared() { m_Mutex.unlock_shared(); };
+
+private:
+
+    std::shared_mutex m_Mutex;
+};
+
+// Одна блокировка на всех: дешевле shared_mutex, когда клиентов мало
+struct TMutexLock
+{
+    void lock() { m_Mutex.lock(); };
+    void unlock() { m_Mutex.unlock(); };
+    void lock_shared() { m_Mutex.lock(); };
+    void unlock_shared() { m_Mutex.unlock(); };
+
+private:
+
+    std::mutex m_Mutex;
+};
+
+// Без блокировок: сплиттер целиком в одном потоке
+struct TNoLock
+{
+    void lock() {};
+    void unlock() {};
+    void lock_shared() {};
+    void unlock_shared() {};
+};
+
+template <class TStorage = ISplitterRing, class TWait = TBlockWait, class TOverflow = TOverflowBlock, class TLock = TSharedMutexLock>
+class BasicSplitter
+{
+public:
+
+    typedef std::chrono::steady_clock::time_point TDeadline;
+
+    // _nMaxBytes - ограничение на размер кадров в очереди, 0 - без ограничения, как у ISplitter
+    BasicSplitter( int _nMaxBuffers, int _nMaxClients, uint64_t _nMaxBytes = 0 )
+        // clients move only under m_Lock, frames are dropped under its exclusive side: the storage may carry them
+        : m_Frames( std::max( _nMaxBuffers, 1 ) + 1, true )
+        , m_Clients( std::max( _nMaxClients, 0 ) )
+        , m_ClientsIds( _nMaxClients )
+        , m_Limits{ std::max( _nMaxBuffers, 1 ), _nMaxBytes }
+    {
+    };
+
+    bool    SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients)
+    {
+        std::shared_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return false;
+
+        *_pnMaxBuffers = m_Limits.nMaxBuffers;
+        *_pnMaxClients = m_Clients.size();
+
+        return true;
+    };
+
+    // То же, а также ограничение на размер кадров в очереди (0 - без ограничения) и их текущий размер в байтах.
+    bool    SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients, OUT uint64_t* _pnMaxBytes, OUT uint64_t* _pnRetainedBytes)
+    {
+        if ( not SplitterInfoGet( _pnMaxBuffers, _pnMaxClients ) ) return false;
+
+        std::shared_lock<TLock> locker( m_Lock );
+
+        *_pnMaxBytes = m_Limits.nMaxBytes;
+        *_pnRetainedBytes = m_Frames.RetainedBytes();
+
+        return true;
+    };
+
+    int    SplitterPut(IN const TFramePtr& _pVecPut, IN int _nTimeOutMsec)
+    {
+        return Put( _pVecPut, std::chrono::steady_clock::now() + std::chrono::milliseconds( _nTimeOutMsec ), false );
+    };
+
+    int    SplitterPut(IN const TFramePtr& _pVecPut, IN TDeadline _Deadline) { return Put( _pVecPut, _Deadline, false ); };
+
+    // При TOverflowBlock, если кадр переполнит очередь, а самый старый кадр ещё не забрали медленные клиенты, кадр не кладём и возвращаем ERR_TIMEOUT. При остальных политиках - как SplitterPut.
+    int    SplitterTryPut(IN const TFramePtr& _pVecPut) { return Put( _pVecPut, TDeadline::min(), true ); };
+
+    bool    SplitterClientAdd(OUT int* _pnClientID)
+    {
+        std::unique_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return false;
+
+        int id = m_ClientsIds.Acquire();
+
+        if ( id == 0 ) return false;
+
+        auto& client = m_Clients[ id - 1 ];
+
+        m_Frames.ClientEnter( m_Frames.End() );
+
+        client.nNext.store( m_Frames.End() );
+        client.nDropped.store( 0 );
+        client.nDroppedReported = 0;
+        client.nSkippedBase = m_Frames.Skipped();
+        client.bActive = true;
+
+        m_nClientsCount++;
+
+        *_pnClientID = id;
+
+        return true;
+    };
+
+    bool    SplitterClientRemove(IN int _nClientID)
+    {
+        std::unique_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return false;
+
+        auto pClient = FindClient( _nClientID );
+
+        if ( pClient == nullptr ) return false;
+
+        pClient->bActive = false;
+
+        m_Frames.ClientLeave( pClient->nNext.load() );
+
+        m_ClientsIds.Release( _nClientID );
+
+        m_nClientsCount--;
+
+        // the client may wait for a frame, the producer - for the client
+        m_NewFrame.Notify();
+        m_ClientMoved.Notify();
+
+        return true;
+    };
+
+    bool    SplitterClientGetCount(OUT int* _pnCount)
+    {
+        std::shared_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return false;
+
+        *_pnCount = m_nClientsCount;
+
+        return true;
+    };
+
+    bool    SplitterClientGetByIndex(IN int _nIndex, OUT int* _pnClientID, OUT int* _pnLatency)
+    {
+        std::shared_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return false;
+
+        int id = m_ClientsIds.Nth( _nIndex );
+
+        if ( id == 0 ) return false;
+
+        *_pnClientID = id;
+
+        *_pnLatency = m_Frames.End() - std::max( m_Clients[ id - 1 ].nNext.load(), m_Frames.Begin() );
+
+        return true;
+    };
+
+    // Перечисление всех клиентов за один проход: заполняем не более _nSize элементов массива _pInfo, в _pnCount возвращаем общее количество клиентов.
+    bool    SplitterClientsSnapshot(OUT TSplitterClientInfo* _pInfo, IN int _nSize, OUT int* _pnCount)
+    {
+        std::shared_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return false;
+
+        *_pnCount = m_nClientsCount;
+
+        int nIndex = 0;
+
+        for ( int id = m_ClientsIds.Next( 0 ); id != 0 && nIndex < _nSize; id = m_ClientsIds.Next( id ) )
+        {
+            auto& client = m_Clients[ id - 1 ];
+
+            auto& info = _pInfo[nIndex++];
+
+            TFrameSeq nNext = client.nNext.load();
+
+            TFrameSeq nBegin = m_Frames.Begin();
+
+            info.nClientID = id;
+            info.nLatency = m_Frames.End() - std::max( nNext, nBegin );
+            info.nLatencyBytes = m_Frames.Bytes( std::max( nNext, nBegin ) );
+            info.nDropped = Dropped( client ) + ( nNext < nBegin ? nBegin - nNext : 0 );
+        }
+        return true;
+    };
+
+    int    SplitterGet(IN int _nClientID, OUT TFramePtr& _pVecGet, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped = nullptr)
+    {
+        return SplitterGet( _nClientID, _pVecGet, std::chrono::steady_clock::now() + std::chrono::milliseconds( _nTimeOutMsec ), _pnSkipped );
+    };
+
+    // Клиент забирает кадры из одного потока: свою позицию он меняет под разделяемой блокировкой
+    int    SplitterGet(IN int _nClientID, OUT TFramePtr& _pVecGet, IN TDeadline _Deadline, OUT uint64_t* _pnSkipped = nullptr)
+    {
+        std::shared_lock<TLock> locker( m_Lock );
+
+        auto pClient = FindClient( _nClientID );
+
+        bool bReady = m_NewFrame.Wait( locker, _Deadline, [&] { return m_bIsClosed || not pClient || not pClient->bActive || pClient->nNext.load() < m_Frames.End(); } );
+
+        if ( m_bIsClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+        if ( pClient == nullptr || not pClient->bActive ) return ISplitter::ERR_BAD_CLIENT_ID;
+
+        if ( not bReady ) return ISplitter::ERR_TIMEOUT;
+
+        TFrameSeq nFrame = pClient->nNext.load();
+
+        TFrameSeq nBegin = m_Frames.Begin();
+
+        // the frames dropped behind the client are skipped now, it is still counted on the oldest one
+        if ( nFrame < nBegin )
+        {
+            pClient->nDropped.fetch_add( nBegin - nFrame );
+
+            nFrame = nBegin;
+        }
+
+        _pVecGet = m_Frames.At( nFrame );
+
+        m_Frames.ClientEnter( nFrame + 1 );
+        m_Frames.ClientLeave( pClient->nNext.exchange( nFrame + 1 ) );
+
+        if ( _pnSkipped )
+        {
+            uint64_t nDropped = Dropped( *pClient );
+
+            *_pnSkipped = nDropped - pClient->nDroppedReported;
+
+            pClient->nDroppedReported = nDropped;
+        }
+
+        // only the client leaving the oldest frame may release a waiting producer
+        if ( nFrame == nBegin && not SplitterHasSlowClients( m_Frames ) ) m_ClientMoved.Notify();
+
+        return ISplitter::NO_ERROR;
+    };
+
+    int    SplitterTryGet(IN int _nClientID, OUT TFramePtr& _pVecGet, OUT uint64_t* _pnSkipped = nullptr)
+    {
+        return SplitterGet( _nClientID, _pVecGet, TDeadline::min(), _pnSkipped );
+    };
+
+    int    SplitterFlush()
+    {
+        std::unique_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+        TFrameSeq nEnd = m_Frames.End();
+
+        // move clients off the frames first, then release them: nothing is counted as dropped
+        for ( int id = m_ClientsIds.Next( 0 ); id != 0; id = m_ClientsIds.Next( id ) )
+        {
+            auto& client = m_Clients[ id - 1 ];
+
+            m_Frames.ClientEnter( nEnd );
+            m_Frames.ClientLeave( client.nNext.exchange( nEnd ) );
+        }
+
+        m_Frames.clear();
+
+        m_ClientMoved.Notify();
+
+        return ISplitter::NO_ERROR;
+    };
+
+    void    SplitterClose()
+    {
+        std::unique_lock<TLock> locker( m_Lock );
+
+        m_bIsClosed = true;
+
+        m_NewFrame.Notify();
+        m_ClientMoved.Notify();
+    };
+
+private:
+
+    struct alignas(CACHE_LINE_SIZE) TClient
+    {
+        std::atomic<TFrameSeq> nNext{0};        // snapshots read it beside the client's own get
+        std::atomic<uint64_t> nDropped{0};      // frames dropped behind the client and skipped
+        uint64_t nDroppedReported{0};
+        uint64_t nSkippedBase{0};               // TStorage::Skipped() when added
+        bool bActive{false};
+    };
+
+    TClient* FindClient( int _nClientID )
+    {
+        if ( _nClientID < 1 || _nClientID > static_cast<int>( m_Clients.size() ) ) return nullptr;
+
+        auto& client = m_Clients[ _nClientID - 1 ];
+
+        return client.bActive ? &client : nullptr;
+    };
+
+    // without the frames still behind the client
+    uint64_t Dropped( const TClient& _Client ) const
+    {
+        return _Client.nDropped.load() + m_Frames.Skipped() - _Client.nSkippedBase;
+    };
+
+    int Put( const TFramePtr& _pFrame, TDeadline _Deadline, bool _bTry )
+    {
+        std::unique_lock<TLock> locker( m_Lock );
+
+        if ( m_bIsClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+        if constexpr ( TOverflow::DROPS_NEWEST )
+        {
+            // skipped by every client at once, counted once
+            if ( m_Limits.NoRoomFor( m_Frames, _pFrame ) && SplitterHasSlowClients( m_Frames ) )
+            {
+                m_Frames.SkipFrame();
+
+                return ISplitter::ERR_FORCED_FRAMES_REMOVE;
+            }
+        }
+
+        if constexpr ( TOverflow::WAITS )
+        {
+            if ( _bTry && m_Limits.NoRoomFor( m_Frames, _pFrame ) && SplitterHasSlowClients( m_Frames ) ) return ISplitter::ERR_TIMEOUT;
+        }
+
+        // the fast clients take the frame at once, the slow ones hold only the oldest
+        m_Frames.push_back( _pFrame );
+
+        m_NewFrame.Notify();
+
+        int res = ISplitter::NO_ERROR;
+
+        while ( m_Limits.Overflowed( m_Frames ) )
+        {
+            if constexpr ( TOverflow::WAITS )
+            {
+                // a wakeup before the deadline that did not free the oldest frame is no reason to drop it
+                m_ClientMoved.Wait( locker, _Deadline, [this] { return m_bIsClosed || not m_Limits.Overflowed( m_Frames ) || not SplitterHasSlowClients( m_Frames ); } );
+
+                if ( m_bIsClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+                // flushed or already trimmed by another producer
+                if ( not m_Limits.Overflowed( m_Frames ) ) break;
+            }
+
+            // no pass over the clients: the storage carries them to the next frame
+            if ( SplitterHasSlowClients( m_Frames ) ) res = ISplitter::ERR_FORCED_FRAMES_REMOVE;
+
+            m_Frames.pop_front();
+        }
+        return res;
+    };
+
+    TLock m_Lock;
+    TStorage m_Frames;
+    std::vector<TClient> m_Clients; // по идентификатору: m_Clients[id-1]
+    ISplitterClientIds m_ClientsIds;
+    int m_nClientsCount{0};
+    const TSplitterLimits m_Limits;
+    bool m_bIsClosed{false};
+
+    TSplitterEvent<TWait> m_NewFrame;
+    TSplitterEvent<TWait> m_ClientMoved;
+};
+
+#endif /*SPLITTER_BASIC_H*/
@@ -1,33 +1,443 @@
 #include "splitter_client.h"
 #include "splitter_definitions.h"
+#include "splitter_ring.h"
+#include "splitter_wait.h"
 
-ISplitterClient::ISplitterClient( int _nId, TNextFrame _pNextFrame)
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <new>
+#include <thread>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Inactive clients point beyond any frame, so they never hold the oldest one
+static constexpr TNextFrame NO_FRAME = std::numeric_limits<TNextFrame>::max();
+
+ISplitterClient::ISplitterClient( int _nId )
     : m_nId(_nId)
-    , m_pNextFrame( _pNextFrame)
+    , m_nNextFrame( NO_FRAME )
+{
+}
+
+ISplitterClient::~ISplitterClient( )
 {
+    if ( HasEventFd() ) close( m_nEventFd );
+}
+
+void ISplitterClient::Activate( TFrameBuf& _Frames, TNextFrame _nFrame )
+{
+    // a get of the previous owner still in flight either sees the new generation in PopFrames and
+    // takes nothing, or has already raised the reader count and is waited for here
+    m_nGeneration.fetch_add( 1 );
+
+    WaitReaders();
+
+    // the previous owner of the id may have left it readable
+    DrainEventFd();
+
+    m_nDropped.store( 0, std::memory_order_relaxed );
+
+    m_nDroppedReported.store( 0, std::memory_order_relaxed );
+
+    // frames that never made it into the buffer are counted once for all clients
+    m_nSkippedBase.store( _Frames.Skipped(), std::memory_order_relaxed );
+
+    m_Latency.Reset();
+
+    TNextFrame frame = NO_FRAME;
+
+    MoveCursor( _Frames, frame, _nFrame );
+
+    // without the splitter lock the producer may have dropped the frame meanwhile
+    frame = _nFrame;
+
+    while ( frame < _Frames.Begin() )
+    {
+        MoveCursor( _Frames, frame, _Frames.Begin() );
+    }
+
+    m_bActive.store( true, std::memory_order_release );
 }
 
-void ISplitterClient::SetNextFrame( TNextFrame _pNextFrame )
+void ISplitterClient::Deactivate( TFrameBuf& _Frames )
 {
-    const std::lock_guard<std::mutex> locker(m_Mutex);
+    m_bActive.store( false, std::memory_order_release );
+
+    TNextFrame frame = m_nNextFrame.load();
+
+    while ( frame != NO_FRAME && not MoveCursor( _Frames, frame, NO_FRAME ) ) {}
 
-    m_pNextFrame = _pNextFrame;
+    WaitReaders();
 }
 
-TFramePtr ISplitterClient::PopFrame()
+void ISplitterClient::SetNextFrame( TFrameBuf& _Frames, TNextFrame _nNextFrame )
 {
-    const std::lock_guard<std::mutex> locker(m_Mutex);
+    TNextFrame frame = m_nNextFrame.load();
+
+    // an inactive client stays without a frame even if removed meanwhile
+    while ( frame != NO_FRAME && not MoveCursor( _Frames, frame, _nNextFrame ) ) {}
+
+    if ( frame == NO_FRAME ) return;
+
+    WaitReaders();
+}
+
+bool ISplitterClient::MoveCursor( TFrameBuf& _Frames, TNextFrame& _nFrom, TNextFrame _nTo )
+{
+    // counted on the new frame before leaving the old one: the producer never misses the client
+    if ( _nTo != NO_FRAME ) _Frames.ClientEnter( _nTo );
+
+    bool bMoved = m_nNextFrame.compare_exchange_strong( _nFrom, _nTo );
+
+    TNextFrame nLeft = bMoved ? _nFrom : _nTo;
+
+    if ( nLeft != NO_FRAME ) _Frames.ClientLeave( nLeft );
+
+    return bMoved;
+}
+
+int ISplitterClient::PopFrames( TFrameBuf& _Frames, TFramePtr* _pFrames, int _nMaxFrames, uint64_t _nGeneration,
+                                TFrameSeq* _pnFrame )
+{
+    // the reader count is raised before the position is read: whoever moves the position
+    // from under us sees it and waits until we are done with the slots
+    m_nReaders.fetch_add( 1 );
+
+    // the id went to a new owner: its frames are not ours
+    if ( m_nGeneration.load() != _nGeneration )
+    {
+        m_nReaders.fetch_sub( 1 );
+
+        return 0;
+    }
+
+    int res = 0;
+
+    TNextFrame frame = m_nNextFrame.load();
+
+    while ( frame < _Frames.End() )
+    {
+        TNextFrame begin = _Frames.Begin();
+
+        if ( frame < begin )
+        {
+            if ( MoveCursor( _Frames, frame, begin ) )
+            {
+                m_nDropped.fetch_add( begin - frame, std::memory_order_relaxed );
+
+                frame = begin;
+            }
+            continue;
+        }
+
+        TNextFrame end = std::min<TNextFrame>( _Frames.End(), frame + std::max( _nMaxFrames, 1 ) );
 
-    auto res = *m_pNextFrame;
+        for ( TNextFrame seq = frame; seq != end; seq++ )
+        {
+            _pFrames[ seq - frame ] = _Frames.At( seq );
+        }
 
-    m_pNextFrame++;
+        if ( MoveCursor( _Frames, frame, end ) )
+        {
+            if ( _pnFrame ) *_pnFrame = frame;
+
+            res = end - frame;
+
+            uint64_t nNowNs = SplitterNowNs();
+
+            uint64_t nPublishNs = 0;
+
+            for ( TNextFrame seq = frame; seq != end; seq++ )
+            {
+                if ( _Frames.PublishTime( seq, nPublishNs ) && nPublishNs <= nNowNs ) m_Latency.Record( nNowNs - nPublishNs );
+            }
+            break;
+        }
+    }
+
+    m_nReaders.fetch_sub( 1 );
 
     return res;
 }
 
-void ISplitterClient::FrameIncrement()
+bool ISplitterClient::FrameIncrement( TFrameBuf& _Frames, TNextFrame _nFrame )
+{
+    if ( m_nNextFrame.load() != _nFrame ) return false;
+
+    if ( not MoveCursor( _Frames, _nFrame, _nFrame + 1 ) ) return false;
+
+    m_nDropped.fetch_add( 1, std::memory_order_relaxed );
+
+    WaitReaders();
+
+    return true;
+}
+
+uint64_t ISplitterClient::Dropped( const TFrameBuf& _Frames ) const
+{
+    TNextFrame frame = m_nNextFrame.load();
+
+    TFrameSeq begin = _Frames.Begin();
+
+    uint64_t nBehind = frame != NO_FRAME && frame < begin ? begin - frame : 0;
+
+    return m_nDropped.load( std::memory_order_relaxed ) + _Frames.Skipped() - m_nSkippedBase.load( std::memory_order_relaxed ) + nBehind;
+}
+
+uint64_t ISplitterClient::TakeSkipped( const TFrameBuf& _Frames )
+{
+    // called after reading frames: nothing is left behind the client
+    uint64_t nDropped = m_nDropped.load( std::memory_order_relaxed ) + _Frames.Skipped() - m_nSkippedBase.load( std::memory_order_relaxed );
+
+    return nDropped - m_nDroppedReported.exchange( nDropped, std::memory_order_relaxed );
+}
+
+bool ISplitterClient::Wait( std::chrono::steady_clock::time_point _Deadline )
+{
+    while ( m_nWoken.exchange( 0 ) == 0 )
+    {
+        if ( std::chrono::steady_clock::now() >= _Deadline ) return false;
+
+        // counted first, word checked by the kernel second: Wake either sees a sleeper or we see its store
+        m_nSleepers.fetch_add( 1 );
+
+        SplitterFutexWait( m_nWoken, 0, _Deadline );
+
+        m_nSleepers.fetch_sub( 1 );
+    }
+    return true;
+}
+
+void ISplitterClient::Wake( )
+{
+    m_nWoken.store( 1 );
+
+    if ( m_nSleepers.load() > 0 ) SplitterFutexWake( m_nWoken );
+
+    std::function<void()> OnAsyncWake;
+
+    {
+        const std::lock_guard<std::mutex> locker(m_WaitMutex);
+
+        OnAsyncWake.swap( m_OnAsyncWake );
+    }
+
+    SignalEventFd();
+
+    if ( OnAsyncWake ) OnAsyncWake();
+}
+
+void ISplitterClient::SetAsyncWake( uint64_t _nToken, std::function<void()> _OnWake )
+{
+    const std::lock_guard<std::mutex> locker(m_WaitMutex);
+
+    m_nAsyncToken = _nToken;
+
+    m_OnAsyncWake = std::move( _OnWake );
+}
+
+bool ISplitterClient::CancelAsyncWake( uint64_t _nToken )
 {
-    const std::lock_guard<std::mutex> locker(m_Mutex);
+    const std::lock_guard<std::mutex> locker(m_WaitMutex);
+
+    if ( m_nAsyncToken != _nToken || not m_OnAsyncWake ) return false;
+
+    m_OnAsyncWake = nullptr;
+
+    return true;
+}
+
+void ISplitterClient::ResetWoken( )
+{
+    m_nWoken.store( 0 );
+}
+
+int ISplitterClient::EventFd( )
+{
+    const std::lock_guard<std::mutex> locker(m_WaitMutex);
+
+    if ( not HasEventFd() ) m_nEventFd.store( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ), std::memory_order_release );
+
+    return m_nEventFd;
+}
+
+void ISplitterClient::SignalEventFd( )
+{
+    int fd = m_nEventFd.load( std::memory_order_acquire );
+
+    if ( fd < 0 ) return;
+
+    uint64_t one = 1;
+
+    // the counter only overflows after 2^64 - 2 unread signals
+    [[maybe_unused]] auto res = write( fd, &one, sizeof( one ) );
+}
+
+void ISplitterClient::DrainEventFd( )
+{
+    int fd = m_nEventFd.load( std::memory_order_acquire );
+
+    if ( fd < 0 ) return;
+
+    uint64_t value = 0;
+
+    // non-blocking: fails with EAGAIN when already drained
+    [[maybe_unused]] auto res = read( fd, &value, sizeof( value ) );
+}
+
+void ISplitterClient::WaitReaders( )
+{
+    while ( m_nReaders.load() > 0 )
+    {
+        std::this_thread::yield();
+    }
+}
+
+// Все позиции клиентов одним непрерывным массивом, по идентификатору: [id-1]
+ISplitterClientTable::ISplitterClientTable( int _nCount )
+    : m_nCount( std::max( _nCount, 0 ) )
+{
+    if ( m_nCount == 0 ) return;
+
+    // one block instead of an allocation per client: the slots are adjacent and line-aligned
+    void* p = ::operator new( m_nCount * sizeof( ISplitterClient ), std::align_val_t( alignof( ISplitterClient ) ) );
+
+    m_pClients = static_cast<ISplitterClient*>( p );
+
+    for ( size_t i = 0; i < m_nCount; i++ )
+    {
+        new ( &m_pClients[i] ) ISplitterClient( static_cast<int>( i + 1 ) );
+    }
+}
+
+ISplitterClientTable::~ISplitterClientTable( )
+{
+    if ( m_pClients == nullptr ) return;
+
+    for ( size_t i = m_nCount; i > 0; i-- )
+    {
+        m_pClients[i - 1].~ISplitterClient();
+    }
+    ::operator delete( m_pClients, std::align_val_t( alignof( ISplitterClient ) ) );
+}
+
+// Свободные идентификаторы клиентов [1, _nCount], по биту на идентификатор
+ISplitterClientIds::ISplitterClientIds( int _nCount )
+    : m_nCount( std::max( _nCount, 0 ) )
+{
+    size_t nCount = m_nCount;
+
+    m_Words.assign( ( nCount + 63 ) / 64, ~uint64_t(0) );
+
+    m_Used.assign( ( m_Words.size() + 63 ) / 64, 0 );
+
+    // ids past the count are never free
+    if ( nCount % 64 != 0 ) m_Words.back() = ( uint64_t(1) << ( nCount % 64 ) ) - 1;
+}
+
+int ISplitterClientIds::Acquire( )
+{
+    while ( m_nFirst < m_Words.size() && m_Words[m_nFirst] == 0 )
+    {
+        m_nFirst++;
+    }
+
+    if ( m_nFirst == m_Words.size() ) return 0;
+
+    uint64_t& word = m_Words[m_nFirst];
+
+    int nBit = std::countr_zero( word );
+
+    word &= word - 1;
+
+    m_Used[m_nFirst / 64] |= uint64_t(1) << ( m_nFirst % 64 );
+
+    return static_cast<int>( m_nFirst * 64 ) + nBit + 1;
+}
+
+void ISplitterClientIds::Release( int _nId )
+{
+    size_t nIndex = _nId - 1;
+
+    size_t nWord = nIndex / 64;
+
+    m_Words[nWord] |= uint64_t(1) << ( nIndex % 64 );
+
+    if ( Taken( nWord ) == 0 ) m_Used[nWord / 64] &= ~( uint64_t(1) << ( nWord % 64 ) );
+
+    m_nFirst = std::min( m_nFirst, nWord );
+}
+
+int ISplitterClientIds::Next( int _nId ) const
+{
+    size_t nIndex = std::max( _nId, 0 );    // the bit of the id after _nId
+
+    if ( nIndex >= static_cast<size_t>( m_nCount ) ) return 0;
+
+    size_t nWord = nIndex / 64;
+
+    // the rest of the current word
+    uint64_t taken = Taken( nWord ) & ( ~uint64_t(0) << ( nIndex % 64 ) );
+
+    if ( taken != 0 ) return static_cast<int>( nWord * 64 ) + std::countr_zero( taken ) + 1;
+
+    // then the next word with a taken id
+    size_t nNext = nWord + 1;
+
+    for ( size_t i = nNext / 64; i < m_Used.size(); i++ )
+    {
+        uint64_t used = m_Used[i];
+
+        if ( i == nNext / 64 ) used &= ~uint64_t(0) << ( nNext % 64 );
+
+        if ( used == 0 ) continue;
+
+        nWord = i * 64 + std::countr_zero( used );
+
+        return static_cast<int>( nWord * 64 ) + std::countr_zero( Taken( nWord ) ) + 1;
+    }
+    return 0;
+}
+
+int ISplitterClientIds::Nth( int _nIndex ) const
+{
+    if ( _nIndex < 0 ) return 0;
+
+    for ( size_t i = 0; i < m_Used.size(); i++ )
+    {
+        for ( uint64_t used = m_Used[i]; used != 0; used &= used - 1 )
+        {
+            size_t nWord = i * 64 + std::countr_zero( used );
+
+            uint64_t taken = Taken( nWord );
+
+            int nTaken = std::popcount( taken );
+
+            if ( _nIndex >= nTaken )
+            {
+                _nIndex -= nTaken;
+
+                continue;
+            }
+
+            while ( _nIndex-- > 0 )
+            {
+                taken &= taken - 1;
+            }
+            return static_cast<int>( nWord * 64 ) + std::countr_zero( taken ) + 1;
+        }
+    }
+    return 0;
+}
+
+uint64_t ISplitterClientIds::Taken( size_t _nWord ) const
+{
+    uint64_t taken = ~m_Words[_nWord];
+
+    // ids past the count are never free, but not taken either
+    if ( _nWord == m_Words.size() - 1 && m_nCount % 64 != 0 ) taken &= ( uint64_t(1) << ( m_nCount % 64 ) ) - 1;
 
-    m_pNextFrame++;
+    return taken;
 }
@@ -2,27 +2,183 @@
 #define SPLITTER_CLIENT_H
 
 #include "splitter_definitions.h"
+#include "splitter_latency.h"
 
-class ISplitterClient
+#include <chrono>
+
+// Позиция клиента в очереди. Объекты создаются сплиттером заранее на каждый идентификатор и живут до его
+// удаления, добавление и удаление клиента только включает и выключает позицию.
+// Позиция сдвигается атомарно, поэтому кадры можно забирать без блокировки сплиттера. Каждый сдвиг
+// отмечается в счётчиках клиентов буфера (ISplitterRing::ClientsAt).
+class alignas(CACHE_LINE_SIZE) ISplitterClient
+{
+public:
+
+    ISplitterClient( int _nId );
+
+    ~ISplitterClient( );
+
+    int Id( ) const { return m_nId; };
+
+    bool Active( ) const { return m_bActive.load( std::memory_order_acquire ); };
+
+    // Номер включения: отличает клиента от следующего владельца того же идентификатора
+    uint64_t Generation( ) const { return m_nGeneration.load( std::memory_order_acquire ); };
+
+    // Клиент включён и с включения _nGeneration не удалялся: идентификатор не перешёл к новому владельцу
+    bool Active( uint64_t _nGeneration ) const { return Active() && Generation() == _nGeneration; };
+
+    // Включаем клиента, он будет получать кадры начиная с _nFrame. Сначала меняем номер включения и ждём
+    // чтения прежнего владельца, чтобы они не забрали кадры нового
+    void Activate( TFrameBuf& _Frames, TNextFrame _nFrame );
+
+    // Выключаем клиента и ждём, пока завершатся начатые чтения кадров
+    void Deactivate( TFrameBuf& _Frames );
+
+    TNextFrame NextFrame( ) const { return m_nNextFrame.load(); };
+
+    void SetNextFrame( TFrameBuf& _Frames, TNextFrame );
+
+    // Забираем до _nMaxFrames очередных кадров одним сдвигом позиции, возвращаем их количество, в _pnFrame -
+    // номер первого из них. Кадры, удалённые из буфера раньше, чем клиент их забрал, пропускаем.
+    // Если клиента с тех пор включили заново (номер включения не _nGeneration), ничего не забираем
+    int PopFrames( TFrameBuf& _Frames, TFramePtr* _pFrames, int _nMaxFrames, uint64_t _nGeneration,
+                   TFrameSeq* _pnFrame = nullptr );
+
+    // Сдвигаем клиента с кадра _nFrame на следующий, если он всё ещё стоит на нём, и ждём, пока завершится
+    // начатое чтение этого кадра. После этого кадр _nFrame можно удалять.
+    bool FrameIncrement( TFrameBuf& _Frames, TNextFrame _nFrame );
+
+    // Количество кадров, удалённых до того, как клиент успел их забрать
+    // Включая кадры, удалённые позади клиента, которые он пропустит при следующем чтении
+    uint64_t Dropped( const TFrameBuf& _Frames ) const;
+
+    // Сколько кадров клиент пропустил с прошлого вызова
+    uint64_t TakeSkipped( const TFrameBuf& _Frames );
+
+    // Каждый клиент ждёт кадр на собственном futex, сплиттер будит только тех, кто ждёт, а системный вызов
+    // делает, только если клиент уже спит. Wait возвращает false, если за время ожидания клиента так и не разбудили.
+    bool Wait( std::chrono::steady_clock::time_point _Deadline );
+
+    void Wake( );
+
+    // Асинхронное ожидание (корутины, подписки): Wake вызывает _OnWake один раз вместо пробуждения потока.
+    // У клиента одно такое ожидание, _nToken отличает его от прошлых.
+    void SetAsyncWake( uint64_t _nToken, std::function<void()> _OnWake );
+
+    // Снимаем ожидание _nToken, если его ещё не сняли: true - теперь им распоряжается вызывающий
+    bool CancelAsyncWake( uint64_t _nToken );
+
+    // Забываем пробуждение, которое никто не дождался
+    void ResetWoken( );
+
+    // eventfd, который Wake делает читаемым. Создаётся при первом запросе и живёт вместе с объектом,
+    // -1, если создать не удалось.
+    int EventFd( );
+
+    bool HasEventFd( ) const { return m_nEventFd.load( std::memory_order_acquire ) >= 0; };
+
+    void SignalEventFd( );
+
+    // Вычитываем eventfd: он перестаёт быть читаемым до следующего SignalEventFd
+    void DrainEventFd( );
+
+    // Счётчики, которые ведут потоки, забирающие кадры этого клиента
+    TSplitterCounters& Counters( ) { return m_Counters; };
+
+    const TSplitterCounters& Counters( ) const { return m_Counters; };
+
+    // Задержки кадров, забранных PopFrames, от помещения в очередь до выдачи
+    ISplitterLatencyHistogram& Latency( ) { return m_Latency; };
+
+    // Признак того, что клиент стоит в списке ждущих сплиттера. Меняется только под блокировкой этого списка.
+    bool m_bParked{false};
+
+private:
+
+    void WaitReaders( );
+
+    // CAS позиции с _nFrom на _nTo вместе со счётчиками клиентов буфера, при неудаче в _nFrom - текущая позиция
+    bool MoveCursor( TFrameBuf& _Frames, TNextFrame& _nFrom, TNextFrame _nTo );
+
+    const int m_nId;
+    std::atomic<TNextFrame> m_nNextFrame;
+    std::atomic<int> m_nReaders{0};
+    std::atomic<uint64_t> m_nDropped{0};
+    std::atomic<uint64_t> m_nDroppedReported{0};
+    std::atomic<uint64_t> m_nSkippedBase{0};    // ISplitterRing::Skipped() при включении
+    std::atomic<bool> m_bActive{false};
+    std::atomic<uint64_t> m_nGeneration{0};
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> m_nWoken{0};  // futex
+    std::atomic<int> m_nSleepers{0};
+    std::mutex m_WaitMutex;
+    std::atomic<int> m_nEventFd{-1};
+    uint64_t m_nAsyncToken{0};
+    std::function<void()> m_OnAsyncWake;
+
+    alignas(CACHE_LINE_SIZE) TSplitterCounters m_Counters;
+
+    ISplitterLatencyHistogram m_Latency;
+};
+
+// Все позиции клиентов одним непрерывным массивом, по идентификатору: [id-1]. Каждая позиция выровнена по
+// строке кэша и занимает целые строки, соседние клиенты не делят их между собой. Массив создаётся вместе со
+// сплиттером и не меняется до его удаления.
+class ISplitterClientTable
 {
 public:
 
-    ISplitterClient( int _nId, TNextFrame _pFrame);
+    explicit ISplitterClientTable( int _nCount );
+
+    ~ISplitterClientTable( );
 
-    TNextFrame NextFrame( ) { return m_pNextFrame; };
+    ISplitterClientTable( const ISplitterClientTable& ) = delete;
+    ISplitterClientTable& operator=( const ISplitterClientTable& ) = delete;
 
-    void SetNextFrame( TNextFrame );
+    ISplitterClient& operator[]( size_t _nIndex ) { return m_pClients[_nIndex]; };
 
-    TFramePtr PopFrame();
+    size_t size( ) const { return m_nCount; };
 
-    void FrameIncrement();
+    ISplitterClient* begin( ) { return m_pClients; };
+    ISplitterClient* end( ) { return m_pClients + m_nCount; };
 
 private:
-    int m_nId;
-    TNextFrame m_pNextFrame;
-    std::mutex m_Mutex;
+
+    ISplitterClient* m_pClients{nullptr};
+    size_t m_nCount{0};
 };
 
-typedef std::shared_ptr<ISplitterClient> ClientPtr;
+// Свободные идентификаторы клиентов [1, _nCount], по биту на идентификатор: на 100 тысяч клиентов - 12 КБ.
+// Выдаётся наименьший свободный, поиск начинается с первого слова, где может быть свободный бит.
+// Занятые перебираются по второму уровню - биту на слово, где есть занятый: проход стоит слов второго уровня
+// (на 100 тысяч клиентов - 25) плюс занятых идентификаторов, а не всей таблицы.
+// Не потокобезопасен, сплиттер вызывает его под блокировкой реестра клиентов.
+class ISplitterClientIds
+{
+public:
+
+    explicit ISplitterClientIds( int _nCount );
+
+    // 0, если свободных идентификаторов нет
+    int Acquire( );
+
+    void Release( int _nId );
+
+    // Наименьший занятый идентификатор больше _nId, 0 - таких нет. Перебор занятых: Next(0), Next(id), ...
+    int Next( int _nId ) const;
+
+    // Занятый идентификатор номер _nIndex по возрастанию, 0 - занятых меньше
+    int Nth( int _nIndex ) const;
+
+private:
+
+    uint64_t Taken( size_t _nWord ) const;
+
+    int      m_nCount{0};
+    std::vector<uint64_t> m_Words;  // единица - идентификатор свободен
+    std::vector<uint64_t> m_Used;   // единица - в слове m_Words есть занятый идентификатор
+    size_t m_nFirst{0};             // в словах до этого свободных нет
+};
 
 #endif /*SPLITTER_CLIENT_H*/
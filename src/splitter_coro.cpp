@@ -0,0 +1,28 @@
+#include "splitter_coro.h"
+#include "splitter.h"
+
+TSplitterGetAwaiter::TSplitterGetAwaiter( ISplitter& _Splitter, int _nClientID, int _nTimeOutMsec )
+    : m_Splitter(_Splitter)
+    , m_nClientID(_nClientID)
+    , m_nTimeOutMsec(_nTimeOutMsec)
+{
+}
+
+void TSplitterGetAwaiter::await_suspend( std::coroutine_handle<> _Handle )
+{
+    // the awaiter lives in the coroutine frame until it is resumed
+    m_Splitter.SplitterGetAsync( m_nClientID, m_nTimeOutMsec, [this, _Handle] ( TSplitterGetResult _Result ) {
+        m_Result = std::move( _Result );
+
+        _Handle.resume();
+    });
+}
+
+TFramePtr ISplitterStream::TNextAwaiter::await_resume( )
+{
+    auto result = m_Get.await_resume();
+
+    m_Stream.m_nError = result.nError;
+
+    return result.nError == ISplitter::NO_ERROR ? std::move( result.pFrame ) : nullptr;
+}
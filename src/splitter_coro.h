@@ -0,0 +1,84 @@
+#ifndef SPLITTER_CORO_H
+#define SPLITTER_CORO_H
+
+#include "splitter_definitions.h"
+
+#include <coroutine>
+
+class ISplitter;
+
+// Результат асинхронного SplitterGet
+struct TSplitterGetResult
+{
+    int nError{0};          // ISplitter::ErrorCode
+    TFramePtr pFrame;
+    uint64_t nSkipped{0};   // сколько кадров клиент пропустил с прошлого успешного вызова
+};
+
+typedef std::function<void(TSplitterGetResult)> TSplitterGetCallback;
+
+// co_await splitter.Get(id, timeout): корутина ждёт кадр, не занимая поток, и продолжается на исполнителе
+// сплиттера (SplitterExecutorSet). Сплиттер должен пережить ожидающие корутины.
+class TSplitterGetAwaiter
+{
+public:
+
+    TSplitterGetAwaiter( ISplitter& _Splitter, int _nClientID, int _nTimeOutMsec );
+
+    bool await_ready( ) { return false; };
+
+    void await_suspend( std::coroutine_handle<> _Handle );
+
+    TSplitterGetResult await_resume( ) { return std::move( m_Result ); };
+
+private:
+
+    ISplitter& m_Splitter;
+    int m_nClientID;
+    int m_nTimeOutMsec;
+    TSplitterGetResult m_Result;
+};
+
+// Кадры клиента один за другим:
+//
+//     auto stream = splitter.Stream(id);
+//     while ( auto pFrame = co_await stream.Next() ) { ... }
+//
+// Пустой кадр - конец: сплиттер закрыт или клиент удалён (код - в Error()). Пропущенные кадры не
+// сообщаются, их видно в SplitterClientsSnapshot.
+class ISplitterStream
+{
+public:
+
+    class TNextAwaiter
+    {
+    public:
+
+        TNextAwaiter( ISplitterStream& _Stream ) : m_Stream(_Stream), m_Get(_Stream.m_Splitter, _Stream.m_nClientID, -1) {};
+
+        bool await_ready( ) { return false; };
+
+        void await_suspend( std::coroutine_handle<> _Handle ) { m_Get.await_suspend( _Handle ); };
+
+        TFramePtr await_resume( );
+
+    private:
+
+        ISplitterStream& m_Stream;
+        TSplitterGetAwaiter m_Get;
+    };
+
+    ISplitterStream( ISplitter& _Splitter, int _nClientID ) : m_Splitter(_Splitter), m_nClientID(_nClientID) {};
+
+    TNextAwaiter Next( ) { return TNextAwaiter( *this ); };
+
+    int Error( ) const { return m_nError; };
+
+private:
+
+    ISplitter& m_Splitter;
+    int m_nClientID;
+    int m_nError{0};
+};
+
+#endif /*SPLITTER_CORO_H*/
@@ -1,16 +1,125 @@
 #ifndef SPLITTER_DEFINITIONS_H
 #define SPLITTER_DEFINITIONS_H
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <list>
 #include <map>
+#include <mutex>
 #include <shared_mutex>
 
 typedef std::vector<uint8_t> TFrame;
 typedef std::shared_ptr<TFrame> TFramePtr;
-typedef std::list<TFramePtr> TFrameBuf;
-typedef TFrameBuf::iterator TNextFrame;
+
+// Вызывается, когда кадр больше никому не нужен
+typedef std::function<void()> TFrameRelease;
+
+// Выполняет задачу где-то ещё: в пуле потоков, в цикле событий. Не должен выполнять её сразу, в вызвавшем
+// потоке - сплиттер может вызывать его под своей блокировкой.
+typedef std::function<void(std::function<void()>)> TSplitterExecutor;
+
+// Подписка на кадры клиента (SplitterSubscribe): очередной кадр и сколько кадров клиент пропустил перед ним
+typedef std::function<void(const TFramePtr& _pFrame, uint64_t _nSkipped)> TSplitterFrameCallback;
+
+// Размер строки кэша: данные, которые пишут разные потоки, разносим по разным строкам
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Время steady_clock в наносекундах, им помечаются кадры
+inline uint64_t SplitterNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Монотонно растущий номер кадра, позиция клиента в очереди
+typedef uint64_t TFrameSeq;
+typedef TFrameSeq TNextFrame;
+
+// Состояние клиента для перечисления одним вызовом
+struct TSplitterClientInfo
+{
+    int nClientID{0};
+    int nLatency{0};            // задержка в кадрах
+    uint64_t nLatencyBytes{0};  // задержка в байтах
+    uint64_t nDropped{0};       // кадры, удалённые до того, как клиент их забрал
+};
+
+// Кадр, зарезервированный под запись (SplitterReserve), до его публикации (SplitterCommit)
+struct TFrameReservation
+{
+    uint8_t* pData{nullptr};   // сюда пишем данные кадра
+    size_t nSize{0};           // сколько байт можно записать
+    TFramePtr pFrame;
+};
+
+// Время от помещения кадров в очередь до выдачи их клиенту (SplitterClientLatencyGet), в наносекундах.
+// Процентили - верхние границы корзин гистограммы.
+struct TSplitterLatency
+{
+    uint64_t nCount{0};
+    uint64_t nMeanNs{0};
+    uint64_t nMaxNs{0};
+    uint64_t nP50Ns{0};
+    uint64_t nP90Ns{0};
+    uint64_t nP99Ns{0};
+    uint64_t nP999Ns{0};
+};
+
+// Счётчики сплиттера (SplitterStatsGet), время - в наносекундах
+struct TSplitterStats
+{
+    uint64_t nFramesPut{0};             // кадры, положенные в очередь
+    uint64_t nFramesGot{0};             // кадры, отданные клиентам
+    uint64_t nForcedRemovals{0};        // кадры, удалённые или не положенные в очередь из-за медленных клиентов
+    uint64_t nTimeouts{0};              // SplitterGet вернул ERR_TIMEOUT
+    uint64_t nSpuriousWakeups{0};       // клиента разбудили, а кадра нет, ожидание продолжилось
+    uint64_t nSlowClientsWaitNs{0};     // кладущие кадры потоки ждали медленных клиентов
+    uint64_t nNewFrameWaitNs{0};        // клиенты ждали новых кадров
+    uint64_t nExclusiveLockWaits{0};    // сколько раз монопольная блокировка оказалась занята
+    uint64_t nExclusiveLockWaitNs{0};
+    uint64_t nSharedLockWaits{0};       // сколько раз разделяемая блокировка оказалась занята
+    uint64_t nSharedLockWaitNs{0};
+};
+
+// Одна часть счётчиков TSplitterStats: свою часть ведёт каждый клиент и кладущая сторона сплиттера,
+// чтобы потоки не писали в одну строку кэша
+struct TSplitterCounters
+{
+    std::atomic<uint64_t> nFramesPut{0};
+    std::atomic<uint64_t> nFramesGot{0};
+    std::atomic<uint64_t> nForcedRemovals{0};
+    std::atomic<uint64_t> nTimeouts{0};
+    std::atomic<uint64_t> nSpuriousWakeups{0};
+    std::atomic<uint64_t> nSlowClientsWaitNs{0};
+    std::atomic<uint64_t> nNewFrameWaitNs{0};
+    std::atomic<uint64_t> nExclusiveLockWaits{0};
+    std::atomic<uint64_t> nExclusiveLockWaitNs{0};
+    std::atomic<uint64_t> nSharedLockWaits{0};
+    std::atomic<uint64_t> nSharedLockWaitNs{0};
+
+    static void Add( std::atomic<uint64_t>& _nCounter, uint64_t _nValue ) { _nCounter.fetch_add( _nValue, std::memory_order_relaxed ); };
+
+    void AddTo( TSplitterStats& _Stats ) const
+    {
+        _Stats.nFramesPut += nFramesPut.load( std::memory_order_relaxed );
+        _Stats.nFramesGot += nFramesGot.load( std::memory_order_relaxed );
+        _Stats.nForcedRemovals += nForcedRemovals.load( std::memory_order_relaxed );
+        _Stats.nTimeouts += nTimeouts.load( std::memory_order_relaxed );
+        _Stats.nSpuriousWakeups += nSpuriousWakeups.load( std::memory_order_relaxed );
+        _Stats.nSlowClientsWaitNs += nSlowClientsWaitNs.load( std::memory_order_relaxed );
+        _Stats.nNewFrameWaitNs += nNewFrameWaitNs.load( std::memory_order_relaxed );
+        _Stats.nExclusiveLockWaits += nExclusiveLockWaits.load( std::memory_order_relaxed );
+        _Stats.nExclusiveLockWaitNs += nExclusiveLockWaitNs.load( std::memory_order_relaxed );
+        _Stats.nSharedLockWaits += nSharedLockWaits.load( std::memory_order_relaxed );
+        _Stats.nSharedLockWaitNs += nSharedLockWaitNs.load( std::memory_order_relaxed );
+    };
+};
+
+class ISplitterRing;
+typedef ISplitterRing TFrameBuf;
 
 typedef std::shared_mutex TLock;
 typedef std::unique_lock< TLock >  TWriteLock;
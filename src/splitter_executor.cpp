@@ -0,0 +1,187 @@
+#include "splitter_executor.h"
+
+#include <algorithm>
+
+// The pool and the queue index of the current thread, if it is a pool thread
+static thread_local const void* s_pCurrentPool = nullptr;
+static thread_local size_t s_nCurrentQueue = 0;
+
+ISplitterThreadPool::ISplitterThreadPool( int _nThreads )
+{
+    for ( int i = 0; i < std::max( _nThreads, 1 ); i++ )
+    {
+        m_Queues.push_back( std::make_unique<TQueue>() );
+    }
+
+    for ( size_t i = 0; i < m_Queues.size(); i++ )
+    {
+        m_Threads.emplace_back( &ISplitterThreadPool::Run, this, i );
+    }
+}
+
+ISplitterThreadPool::~ISplitterThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+
+        m_bStop = true;
+    }
+    m_HasTasks.notify_all();
+
+    for ( auto& thread : m_Threads )
+    {
+        thread.join();
+    }
+}
+
+void ISplitterThreadPool::Post( std::function<void()> _Task )
+{
+    size_t nIndex = s_pCurrentPool == this ? s_nCurrentQueue
+                                           : m_nNextQueue.fetch_add( 1, std::memory_order_relaxed ) % m_Queues.size();
+
+    {
+        std::lock_guard<std::mutex> locker( m_Queues[nIndex]->Mutex );
+
+        m_Queues[nIndex]->Tasks.push_back( std::move( _Task ) );
+    }
+
+    m_nPending.fetch_add( 1 );
+
+    // a thread about to sleep either sees the task counted or gets the notification
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+    }
+    m_HasTasks.notify_one();
+}
+
+TSplitterExecutor ISplitterThreadPool::Executor()
+{
+    return [this] ( std::function<void()> _Task ) { Post( std::move( _Task ) ); };
+}
+
+bool ISplitterThreadPool::Pop( size_t _nIndex, std::function<void()>& _Task )
+{
+    auto& queue = *m_Queues[_nIndex];
+
+    std::lock_guard<std::mutex> locker( queue.Mutex );
+
+    if ( queue.Tasks.empty() ) return false;
+
+    _Task = std::move( queue.Tasks.front() );
+
+    queue.Tasks.pop_front();
+
+    return true;
+}
+
+bool ISplitterThreadPool::Steal( size_t _nIndex, std::function<void()>& _Task )
+{
+    for ( size_t i = 1; i < m_Queues.size(); i++ )
+    {
+        auto& queue = *m_Queues[ ( _nIndex + i ) % m_Queues.size() ];
+
+        std::lock_guard<std::mutex> locker( queue.Mutex );
+
+        if ( queue.Tasks.empty() ) continue;
+
+        _Task = std::move( queue.Tasks.front() );
+
+        queue.Tasks.pop_front();
+
+        return true;
+    }
+    return false;
+}
+
+void ISplitterThreadPool::Run( size_t _nIndex )
+{
+    s_pCurrentPool = this;
+    s_nCurrentQueue = _nIndex;
+
+    std::function<void()> task;
+
+    while ( true )
+    {
+        if ( Pop( _nIndex, task ) || Steal( _nIndex, task ) )
+        {
+            m_nPending.fetch_sub( 1 );
+
+            task();
+
+            task = nullptr;
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> locker( m_Mutex );
+
+        m_HasTasks.wait( locker, [this] { return m_bStop || m_nPending.load() > 0; } );
+
+        // stop only once every queue is drained
+        if ( m_nPending.load() <= 0 ) return;
+    }
+}
+
+ISplitterTimer::ISplitterTimer()
+    : m_Thread( &ISplitterTimer::Run, this )
+{
+}
+
+ISplitterTimer::~ISplitterTimer()
+{
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+
+        m_bStop = true;
+    }
+    m_Changed.notify_all();
+
+    m_Thread.join();
+}
+
+void ISplitterTimer::At( std::chrono::steady_clock::time_point _Time, std::function<void()> _Task )
+{
+    bool bEarliest = false;
+
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+
+        bEarliest = m_Tasks.empty() || _Time < m_Tasks.begin()->first;
+
+        m_Tasks.emplace( _Time, std::move( _Task ) );
+    }
+
+    if ( bEarliest ) m_Changed.notify_one();
+}
+
+void ISplitterTimer::Run()
+{
+    std::unique_lock<std::mutex> locker( m_Mutex );
+
+    while ( not m_bStop )
+    {
+        if ( m_Tasks.empty() )
+        {
+            m_Changed.wait( locker );
+            continue;
+        }
+
+        auto it = m_Tasks.begin();
+
+        if ( std::chrono::steady_clock::now() < it->first )
+        {
+            m_Changed.wait_until( locker, it->first );
+            continue;
+        }
+
+        auto task = std::move( it->second );
+
+        m_Tasks.erase( it );
+
+        locker.unlock();
+
+        task();
+
+        locker.lock();
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SPLITTER_EXECUTOR_H
+#define SPLITTER_EXECUTOR_H
+
+#include "splitter_definitions.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+// Пул потоков с очередью задач у каждого потока. Задачу, поставленную из потока пула, берёт тот же поток,
+// остальные раскладываются по очередям по кругу, освободившийся поток забирает задачи из чужих очередей.
+// Задачи, поставленные до удаления пула, выполняются до конца деструктора, в том числе поставленные
+// самими задачами.
+class ISplitterThreadPool
+{
+public:
+
+    ISplitterThreadPool( int _nThreads );
+
+    ~ISplitterThreadPool();
+
+    void Post( std::function<void()> _Task );
+
+    // Исполнитель, ставящий задачи в этот пул. Действителен, пока жив пул.
+    TSplitterExecutor Executor();
+
+private:
+
+    struct alignas(CACHE_LINE_SIZE) TQueue
+    {
+        std::mutex Mutex;
+        std::deque<std::function<void()>> Tasks;
+    };
+
+    void Run( size_t _nIndex );
+
+    // Задачи берутся по порядку постановки и из своей, и из чужой очереди: задача, ставящая следующую,
+    // не вытесняет остальных
+    bool Pop( size_t _nIndex, std::function<void()>& _Task );
+    bool Steal( size_t _nIndex, std::function<void()>& _Task );
+
+    std::vector<std::unique_ptr<TQueue>> m_Queues;
+    std::atomic<size_t> m_nNextQueue{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_nPending{0}; // может ненадолго уйти в минус: задачу взяли раньше, чем посчитали
+
+    // спящие потоки
+    std::mutex m_Mutex;
+    std::condition_variable m_HasTasks;
+    bool m_bStop{false};
+    std::vector<std::thread> m_Threads;
+};
+
+// Один поток, выполняющий задачи в заданное время. Задачи, не дождавшиеся своего времени до удаления
+// таймера, не выполняются.
+class ISplitterTimer
+{
+public:
+
+    ISplitterTimer();
+
+    ~ISplitterTimer();
+
+    void At( std::chrono::steady_clock::time_point _Time, std::function<void()> _Task );
+
+private:
+
+    void Run();
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> m_Tasks;
+    bool m_bStop{false};
+    std::thread m_Thread;
+};
+
+#endif /*SPLITTER_EXECUTOR_H*/
@@ -0,0 +1,103 @@
+#include "splitter_frame_pool.h"
+
+#include <algorithm>
+
+static int SizeClass( size_t _nSize )
+{
+    int nClass = 0;
+
+    while ( ( size_t(1) << nClass ) < _nSize )
+    {
+        nClass++;
+    }
+    return nClass;
+}
+
+std::shared_ptr<ISplitterFramePool> ISplitterFramePool::Create( int _nMaxFreeFrames )
+{
+    return std::shared_ptr<ISplitterFramePool>( new ISplitterFramePool( _nMaxFreeFrames ) );
+}
+
+ISplitterFramePool::ISplitterFramePool( int _nMaxFreeFrames )
+    : m_nMaxFreeFrames( std::max( _nMaxFreeFrames, 0 ) )
+{
+}
+
+ISplitterFramePool::~ISplitterFramePool()
+{
+    for ( auto& sizeClass : m_Classes )
+    {
+        for ( auto pFrame : sizeClass.Free )
+        {
+            delete pFrame;
+        }
+    }
+}
+
+TFramePtr ISplitterFramePool::Acquire( size_t _nSize )
+{
+    int nClass = std::max( SizeClass( _nSize ), MIN_CLASS );
+
+    if ( nClass > MAX_CLASS ) return std::make_shared<TFrame>( _nSize );
+
+    TFrame* pFrame = nullptr;
+
+    {
+        auto& sizeClass = m_Classes[nClass];
+
+        const std::lock_guard<std::mutex> locker(sizeClass.Mutex);
+
+        if ( not sizeClass.Free.empty() )
+        {
+            pFrame = sizeClass.Free.back();
+
+            sizeClass.Free.pop_back();
+        }
+    }
+
+    if ( pFrame == nullptr )
+    {
+        pFrame = new TFrame();
+
+        pFrame->reserve( size_t(1) << nClass );
+    }
+
+    // a recycled buffer keeps its old size, so only the grown tail gets zeroed
+    pFrame->resize( _nSize );
+
+    // the frame keeps the pool alive until it comes back
+    return TFramePtr( pFrame, [pPool = shared_from_this()] ( TFrame* _pFrame ) { pPool->Release( _pFrame ); } );
+}
+
+size_t ISplitterFramePool::FreeFrames( )
+{
+    size_t res = 0;
+
+    for ( auto& sizeClass : m_Classes )
+    {
+        const std::lock_guard<std::mutex> locker(sizeClass.Mutex);
+
+        res += sizeClass.Free.size();
+    }
+    return res;
+}
+
+void ISplitterFramePool::Release( TFrame* _pFrame )
+{
+    int nClass = SizeClass( _pFrame->capacity() + 1 ) - 1;
+
+    if ( nClass >= MIN_CLASS && nClass <= MAX_CLASS )
+    {
+        auto& sizeClass = m_Classes[nClass];
+
+        const std::lock_guard<std::mutex> locker(sizeClass.Mutex);
+
+        if ( sizeClass.Free.size() < m_nMaxFreeFrames )
+        {
+            sizeClass.Free.push_back( _pFrame );
+
+            return;
+        }
+    }
+    delete _pFrame;
+}
@@ -0,0 +1,43 @@
+#ifndef SPLITTER_FRAME_POOL_H
+#define SPLITTER_FRAME_POOL_H
+
+#include "splitter_definitions.h"
+
+// Пул кадров по классам размеров (степени двойки). Кадр, выданный пулом, возвращается в него, когда
+// пропадает последняя ссылка на него, и выдаётся снова без выделения памяти. Пул живёт, пока жив хотя бы
+// один выданный им кадр.
+class ISplitterFramePool : public std::enable_shared_from_this<ISplitterFramePool>
+{
+public:
+
+    // _nMaxFreeFrames - сколько свободных кадров каждого класса держим, лишние освобождаем
+    static std::shared_ptr<ISplitterFramePool> Create( int _nMaxFreeFrames );
+
+    ~ISplitterFramePool();
+
+    // Кадр размера _nSize. Содержимое не определено: это данные предыдущего владельца буфера.
+    TFramePtr Acquire( size_t _nSize );
+
+    // Количество свободных кадров в пуле
+    size_t FreeFrames( );
+
+private:
+
+    ISplitterFramePool( int _nMaxFreeFrames );
+
+    void Release( TFrame* _pFrame );
+
+    static constexpr int MIN_CLASS = 6;   // 64 B
+    static constexpr int MAX_CLASS = 27;  // 128 MB, кадры больше не кэшируем
+
+    struct TSizeClass
+    {
+        std::mutex Mutex;
+        std::vector<TFrame*> Free;
+    };
+
+    const size_t m_nMaxFreeFrames;
+    TSizeClass m_Classes[MAX_CLASS + 1];
+};
+
+#endif /*SPLITTER_FRAME_POOL_H*/
@@ -0,0 +1,116 @@
+#include "splitter_latency.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Values below 2 * SUB_BUCKETS get a bucket each, above that every power of two is split into
+// SUB_BUCKETS buckets indexed by the bits right below the highest one
+size_t ISplitterLatencyHistogram::BucketIndex( uint64_t _nValue )
+{
+    if ( _nValue < 2 * SUB_BUCKETS ) return _nValue;
+
+    _nValue = std::min( _nValue, ( uint64_t(1) << MAX_BITS ) - 1 );
+
+    int nShift = 63 - __builtin_clzll( _nValue ) - SUB_BITS;
+
+    return SUB_BUCKETS * nShift + ( _nValue >> nShift );
+}
+
+uint64_t ISplitterLatencyHistogram::BucketTop( size_t _nIndex )
+{
+    if ( _nIndex < 2 * SUB_BUCKETS ) return _nIndex;
+
+    int nShift = _nIndex / SUB_BUCKETS - 1;
+
+    uint64_t nTop = _nIndex % SUB_BUCKETS + SUB_BUCKETS;
+
+    return ( ( nTop + 1 ) << nShift ) - 1;
+}
+
+ISplitterLatencyHistogram::~ISplitterLatencyHistogram( )
+{
+    delete[] m_pBuckets.load( std::memory_order_relaxed );
+}
+
+std::atomic<uint64_t>* ISplitterLatencyHistogram::Allocate( )
+{
+    auto pBuckets = new std::atomic<uint64_t>[BUCKETS]{};
+
+    std::atomic<uint64_t>* pInstalled = nullptr;
+
+    // two first records may race, the loser takes the winner's buckets
+    if ( m_pBuckets.compare_exchange_strong( pInstalled, pBuckets, std::memory_order_acq_rel ) ) return pBuckets;
+
+    delete[] pBuckets;
+
+    return pInstalled;
+}
+
+void ISplitterLatencyHistogram::Record( uint64_t _nValueNs )
+{
+    auto pBuckets = m_pBuckets.load( std::memory_order_acquire );
+
+    if ( pBuckets == nullptr ) pBuckets = Allocate();
+
+    pBuckets[ BucketIndex( _nValueNs ) ].fetch_add( 1, std::memory_order_relaxed );
+
+    m_nSumNs.fetch_add( _nValueNs, std::memory_order_relaxed );
+
+    uint64_t nMax = m_nMaxNs.load( std::memory_order_relaxed );
+
+    while ( nMax < _nValueNs && not m_nMaxNs.compare_exchange_weak( nMax, _nValueNs, std::memory_order_relaxed ) )
+    {
+    }
+}
+
+void ISplitterLatencyHistogram::Reset( )
+{
+    TSplitterLatency latency;
+
+    Take( latency, true );
+}
+
+void ISplitterLatencyHistogram::Take( TSplitterLatency& _Latency, bool _bReset )
+{
+    uint64_t counts[BUCKETS] = {};
+
+    _Latency = TSplitterLatency();
+
+    auto pBuckets = m_pBuckets.load( std::memory_order_acquire );
+
+    for ( size_t i = 0; pBuckets != nullptr && i < BUCKETS; i++ )
+    {
+        counts[i] = _bReset ? pBuckets[i].exchange( 0, std::memory_order_relaxed ) : pBuckets[i].load( std::memory_order_relaxed );
+
+        _Latency.nCount += counts[i];
+    }
+
+    uint64_t nSum = _bReset ? m_nSumNs.exchange( 0, std::memory_order_relaxed ) : m_nSumNs.load( std::memory_order_relaxed );
+
+    _Latency.nMaxNs = _bReset ? m_nMaxNs.exchange( 0, std::memory_order_relaxed ) : m_nMaxNs.load( std::memory_order_relaxed );
+
+    if ( _Latency.nCount == 0 ) return;
+
+    _Latency.nMeanNs = nSum / _Latency.nCount;
+
+    std::pair<double, uint64_t*> percentiles[] = {
+        { 0.5, &_Latency.nP50Ns }, { 0.9, &_Latency.nP90Ns }, { 0.99, &_Latency.nP99Ns }, { 0.999, &_Latency.nP999Ns }
+    };
+
+    uint64_t nSeen = 0;
+
+    size_t nIndex = 0;
+
+    for ( auto& percentile : percentiles )
+    {
+        uint64_t nRank = std::max<uint64_t>( 1, std::ceil( percentile.first * _Latency.nCount ) );
+
+        while ( nIndex < BUCKETS && nSeen + counts[nIndex] < nRank )
+        {
+            nSeen += counts[nIndex++];
+        }
+
+        // the bucket top may lie above anything recorded
+        *percentile.second = std::min( BucketTop( std::min( nIndex, BUCKETS - 1 ) ), _Latency.nMaxNs );
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SPLITTER_LATENCY_H
+#define SPLITTER_LATENCY_H
+
+#include "splitter_definitions.h"
+
+// Гистограмма задержек с логарифмическими корзинами (как в HDR Histogram): на каждую степень двойки
+// SUB_BUCKETS корзин, то есть относительная погрешность не больше 1/SUB_BUCKETS. Запись - пара атомарных
+// сложений без блокировок, снять и обнулить гистограмму можно одновременно с записью: каждое значение
+// попадает ровно в один снимок. Корзины выделяются при первой записи: у сплиттера на много клиентов
+// большинство может так и не забрать ни кадра.
+class ISplitterLatencyHistogram
+{
+public:
+
+    ISplitterLatencyHistogram( ) = default;
+
+    ~ISplitterLatencyHistogram( );
+
+    ISplitterLatencyHistogram( const ISplitterLatencyHistogram& ) = delete;
+    ISplitterLatencyHistogram& operator=( const ISplitterLatencyHistogram& ) = delete;
+
+    void Record( uint64_t _nValueNs );
+
+    void Reset( );
+
+    // Процентили и прочее по текущему содержимому, с _bReset - забираем содержимое, обнуляя гистограмму
+    void Take( TSplitterLatency& _Latency, bool _bReset );
+
+private:
+
+    static constexpr int SUB_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BITS;
+    static constexpr int MAX_BITS = 36;     // ~68 с, большие значения попадают в последнюю корзину
+    static constexpr size_t BUCKETS = ( MAX_BITS - SUB_BITS + 1 ) * SUB_BUCKETS;
+
+    static size_t BucketIndex( uint64_t _nValue );
+
+    // Наибольшее значение, попадающее в корзину
+    static uint64_t BucketTop( size_t _nIndex );
+
+    std::atomic<uint64_t>* Allocate( );
+
+    std::atomic<std::atomic<uint64_t>*> m_pBuckets{nullptr};   // BUCKETS корзин
+    std::atomic<uint64_t> m_nSumNs{0};
+    std::atomic<uint64_t> m_nMaxNs{0};
+};
+
+#endif /*SPLITTER_LATENCY_H*/
@@ -0,0 +1,139 @@
+#include "splitter_ring.h"
+
+#include <algorithm>
+
+static size_t RingCapacity( int _nCapacity )
+{
+    size_t capacity = 1;
+
+    while ( capacity < static_cast<size_t>( std::max( _nCapacity, 1 ) ) )
+    {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+ISplitterRing::ISplitterRing( int _nCapacity, bool _bCarryClients )
+    : m_Slots( RingCapacity( _nCapacity ) )
+    , m_nMask( m_Slots.size() - 1 )
+    , m_Clients( m_Slots.size() * 2 )
+    , m_nClientsMask( m_Clients.size() - 1 )
+    , m_bCarryClients( _bCarryClients )
+{
+}
+
+void ISplitterRing::ClientLeave( TFrameSeq _nSeq )
+{
+    // a client left behind the oldest frame is counted on it
+    if ( m_bCarryClients ) _nSeq = std::max( _nSeq, Begin() );
+
+    m_Clients[ _nSeq & m_nClientsMask ].n.fetch_sub( 1 );
+}
+
+void ISplitterRing::push_back( const TFramePtr& _pFrame, uint64_t _nPublishNs )
+{
+    // several producers may each overshoot the limit by one frame while waiting for slow clients
+    if ( size() == m_Slots.size() ) Grow();
+
+    TFrameSeq end = m_nEnd.load( std::memory_order_relaxed );
+
+    uint64_t bytes = m_nBytesTotal.load( std::memory_order_relaxed );
+
+    auto& slot = m_Slots[ end & m_nMask ];
+
+    slot.pFrame = _pFrame;
+    slot.nBytesBefore.store( bytes, std::memory_order_relaxed );
+
+    // released after the slot was freed: whoever reads the new time also sees the old frame gone
+    slot.nPublishNs.store( _nPublishNs, std::memory_order_release );
+
+    uint64_t size = _pFrame ? _pFrame->size() : 0;
+
+    m_nBytesTotal.store( bytes + size, std::memory_order_relaxed );
+
+    m_nBytesRetained.store( m_nBytesRetained.load( std::memory_order_relaxed ) + size, std::memory_order_relaxed );
+
+    // readers see the slot filled once they see the new end
+    m_nEnd.store( end + 1, std::memory_order_release );
+}
+
+void ISplitterRing::pop_front()
+{
+    if ( empty() ) return;
+
+    TFrameSeq begin = m_nBegin.load( std::memory_order_relaxed );
+
+    auto& slot = m_Slots[ begin & m_nMask ];
+
+    // the frame itself may have been resized since, its size is the distance to the next one
+    uint64_t after = begin + 1 == End() ? m_nBytesTotal.load( std::memory_order_relaxed )
+                                        : m_Slots[ ( begin + 1 ) & m_nMask ].nBytesBefore.load( std::memory_order_relaxed );
+
+    m_nBytesRetained.store( m_nBytesRetained.load( std::memory_order_relaxed ) - ( after - slot.nBytesBefore.load( std::memory_order_relaxed ) ), std::memory_order_relaxed );
+
+    slot.pFrame.reset();
+
+    if ( m_bCarryClients )
+    {
+        int clients = m_Clients[ begin & m_nClientsMask ].n.exchange( 0 );
+
+        m_Clients[ ( begin + 1 ) & m_nClientsMask ].n.fetch_add( clients );
+    }
+
+    m_nBegin.store( begin + 1, std::memory_order_release );
+}
+
+uint64_t ISplitterRing::Bytes( TFrameSeq _nSeq ) const
+{
+    if ( _nSeq >= End() ) return 0;
+
+    auto& slot = m_Slots[ std::max( _nSeq, Begin() ) & m_nMask ];
+
+    return m_nBytesTotal.load( std::memory_order_relaxed ) - slot.nBytesBefore.load( std::memory_order_relaxed );
+}
+
+bool ISplitterRing::PublishTime( TFrameSeq _nSeq, uint64_t& _nTimeNs ) const
+{
+    _nTimeNs = m_Slots[ _nSeq & m_nMask ].nPublishNs.load( std::memory_order_acquire );
+
+    return _nSeq >= Begin() && _nSeq < End();
+}
+
+void ISplitterRing::clear()
+{
+    while ( not empty() )
+    {
+        pop_front();
+    }
+}
+
+// Only called under the exclusive splitter lock: readers may not touch the slots nor move clients meanwhile
+void ISplitterRing::Grow()
+{
+    std::vector<TSlot> slots( m_Slots.size() * 2 );
+
+    TFrameSeq mask = slots.size() - 1;
+
+    std::vector<TClientCount> clients( slots.size() * 2 );
+
+    TFrameSeq clientsMask = clients.size() - 1;
+
+    for ( TFrameSeq seq = Begin(); seq != End() + 1; seq++ )
+    {
+        clients[ seq & clientsMask ].n.store( ClientsAt( seq ), std::memory_order_relaxed );
+    }
+    m_Clients.swap( clients );
+    m_nClientsMask = clientsMask;
+
+    for ( TFrameSeq seq = Begin(); seq != End(); seq++ )
+    {
+        auto& from = m_Slots[ seq & m_nMask ];
+        auto& to = slots[ seq & mask ];
+
+        to.pFrame = std::move( from.pFrame );
+        to.nBytesBefore.store( from.nBytesBefore.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        to.nPublishNs.store( from.nPublishNs.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    }
+    m_Slots.swap( slots );
+    m_nMask = mask;
+}
@@ -0,0 +1,127 @@
+#ifndef SPLITTER_RING_H
+#define SPLITTER_RING_H
+
+#include "splitter_definitions.h"
+
+// Кольцевой буфер кадров. Ячейки выделяются один раз, кадр адресуется своим номером (TFrameSeq),
+// номер ячейки - младшие биты номера кадра.
+// Добавляет и удаляет кадры один поток (или потоки под общей блокировкой), читать кадры из диапазона
+// [Begin(), End()) можно одновременно с ним без блокировок: End() публикуется после записи ячейки.
+// Буфер также считает клиентов на каждом кадре, чтобы сплиттер не перебирал их, проверяя самый старый.
+class ISplitterRing
+{
+public:
+
+    // _bCarryClients: клиенты удаляемого кадра переходят на следующий (в счёте), а их позиции остаются
+    // позади Begin() до их следующего чтения. Только если клиентов не двигают одновременно с удалением кадров.
+    ISplitterRing( int _nCapacity, bool _bCarryClients = false );
+
+    // Номер самого старого кадра в буфере
+    TFrameSeq Begin() const { return m_nBegin.load( std::memory_order_acquire ); };
+
+    // Номер, который получит следующий добавленный кадр
+    TFrameSeq End() const { return m_nEnd.load( std::memory_order_acquire ); };
+
+    size_t size() const { return End() - Begin(); };
+
+    bool empty() const { return End() == Begin(); };
+
+    const TFramePtr& At( TFrameSeq _nSeq ) const { return m_Slots[ _nSeq & m_nMask ].pFrame; };
+
+    // Суммарный размер кадров начиная с _nSeq и до конца буфера
+    uint64_t Bytes( TFrameSeq _nSeq ) const;
+
+    // Суммарный размер кадров в буфере
+    uint64_t RetainedBytes() const { return m_nBytesRetained.load( std::memory_order_relaxed ); };
+
+    // Время помещения кадра _nSeq в буфер. false, если кадр уже удалён: ячейку мог занять другой кадр.
+    bool PublishTime( TFrameSeq _nSeq, uint64_t& _nTimeNs ) const;
+
+    // Сколько клиентов стоит на кадре _nSeq из [Begin(), End()]. Клиент сначала встаёт на новый кадр, потом
+    // уходит со старого (ISplitterClient), поэтому счёт может быть на время больше, но не меньше.
+    int ClientsAt( TFrameSeq _nSeq ) const { return m_Clients[ _nSeq & m_nClientsMask ].n.load(); };
+
+    void ClientEnter( TFrameSeq _nSeq ) { m_Clients[ _nSeq & m_nClientsMask ].n.fetch_add( 1 ); };
+
+    void ClientLeave( TFrameSeq _nSeq );
+
+    // Кадры, так и не попавшие в буфер (OVERFLOW_DROP_NEWEST): их пропустили все клиенты сразу
+    void SkipFrame() { m_nSkipped.fetch_add( 1, std::memory_order_relaxed ); };
+
+    uint64_t Skipped() const { return m_nSkipped.load( std::memory_order_relaxed ); };
+
+    void push_back( const TFramePtr& _pFrame, uint64_t _nPublishNs = 0 );
+
+    void pop_front();
+
+    void clear();
+
+private:
+
+    void Grow();
+
+    struct TSlot
+    {
+        TFramePtr pFrame;
+        std::atomic<uint64_t> nBytesBefore{0}; // размер всех кадров, добавленных до этого
+        std::atomic<uint64_t> nPublishNs{0};   // steady_clock
+    };
+
+    // Каждый счётчик на своей строке кэша: клиенты на соседних кадрах не мешают друг другу
+    struct alignas(CACHE_LINE_SIZE) TClientCount
+    {
+        std::atomic<int> n{0};
+    };
+
+    std::vector<TSlot> m_Slots;
+    TFrameSeq m_nMask{0};
+    std::vector<TClientCount> m_Clients; // вдвое больше ячеек: End() не делит счётчик с Begin()
+    TFrameSeq m_nClientsMask{0};
+    const bool m_bCarryClients;
+    std::atomic<uint64_t> m_nSkipped{0};
+    std::atomic<uint64_t> m_nBytesTotal{0};
+    std::atomic<uint64_t> m_nBytesRetained{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<TFrameSeq> m_nBegin{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<TFrameSeq> m_nEnd{0};
+};
+
+// Правила переполнения очереди, общие для ISplitter и BasicSplitter. _Frames - ISplitterRing или хранилище
+// с тем же набором вызовов (Begin, size, RetainedBytes, ClientsAt).
+
+// Самый старый кадр ещё не забрали: медленные клиенты стоят на нём (или, перенесённые, позади него)
+template <class TFrames>
+bool SplitterHasSlowClients( const TFrames& _Frames )
+{
+    return _Frames.ClientsAt( _Frames.Begin() ) > 0;
+}
+
+struct TSplitterLimits
+{
+    int nMaxBuffers{0};
+    uint64_t nMaxBytes{0};  // 0 - без ограничения
+
+    // Кадр уже положен, и очередь больше ограничений: самый старый кадр должен уйти
+    template <class TFrames>
+    bool Overflowed( const TFrames& _Frames ) const
+    {
+        size_t nFrames = _Frames.size();
+
+        if ( nFrames > static_cast<size_t>( nMaxBuffers ) ) return true;
+
+        // the newest frame stays even if it alone is over the budget
+        return nMaxBytes > 0 && nFrames > 1 && _Frames.RetainedBytes() > nMaxBytes;
+    };
+
+    // Кадр _pFrame ещё не положен, но для него уже нет места
+    template <class TFrames>
+    bool NoRoomFor( const TFrames& _Frames, const TFramePtr& _pFrame ) const
+    {
+        size_t nFrames = _Frames.size();
+
+        if ( nFrames >= static_cast<size_t>( nMaxBuffers ) ) return true;
+
+        return nMaxBytes > 0 && nFrames > 0 && _Frames.RetainedBytes() + ( _pFrame ? _pFrame->size() : 0 ) > nMaxBytes;
+    };
+};
+
+#endif /*SPLITTER_RING_H*/
@@ -0,0 +1,537 @@
+#include "splitter_shm.h"
+#include "splitter_wait.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+static constexpr uint64_t SHM_MAGIC = 0x52455454494c5053ull; // "SPLITTER"
+
+static constexpr TFrameSeq NO_FRAME = std::numeric_limits<TFrameSeq>::max();
+
+// a consumer that died without SplitterClientRemove is noticed this often while the producer waits for it
+static constexpr auto REAP_INTERVAL = 100ms;
+
+static_assert( std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+               "atomics in shared memory must not need a process-local lock" );
+static_assert( sizeof( std::atomic<uint32_t> ) == sizeof( uint32_t ), "a futex word is a plain 32-bit integer" );
+
+// Everything below lives in the segment: no pointers, only offsets and address-free atomics
+
+struct ISplitterShm::THeader
+{
+    std::atomic<uint64_t> nMagic{0};    // written last, attach fails until then
+    uint64_t nSegmentSize{0};
+    uint64_t nMaxFrameSize{0};
+    uint64_t nFrameStride{0};
+    uint32_t nMaxBuffers{0};
+    uint32_t nMaxClients{0};
+    std::atomic<uint32_t> bClosed{0};
+
+    alignas(CACHE_LINE_SIZE) std::atomic<TFrameSeq> nBegin{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<TFrameSeq> nEnd{0};
+
+    // futex words: bumped on every change the waiters care about
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> nNewFrame{0};
+    std::atomic<uint32_t> nGetWaiters{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> nSpace{0};
+    std::atomic<uint32_t> nPutWaiters{0};
+};
+
+struct alignas(CACHE_LINE_SIZE) ISplitterShm::TClient
+{
+    enum : uint32_t { FREE=0, INIT, ACTIVE };
+
+    std::atomic<uint32_t> eState{FREE};
+    std::atomic<pid_t> nPid{0};                    // process that added the client
+    std::atomic<TFrameSeq> nNextFrame{NO_FRAME};
+    std::atomic<TFrameSeq> nHeld{NO_FRAME};        // frame handed out by the last SplitterGet
+    std::atomic<uint64_t> nDropped{0};
+    std::atomic<uint64_t> nDroppedReported{0};
+};
+
+// The slot number is a seqlock: NO_FRAME while the payload is being rewritten
+struct alignas(CACHE_LINE_SIZE) ISplitterShm::TSlot
+{
+    std::atomic<TFrameSeq> nSeq{NO_FRAME};
+    std::atomic<uint64_t> nSize{0};
+};
+
+static size_t AlignUp( size_t _nSize, size_t _nAlign )
+{
+    return ( _nSize + _nAlign - 1 ) / _nAlign * _nAlign;
+}
+
+std::shared_ptr<ISplitterShm> ISplitterShm::Create(const std::string& _Name, int _nMaxBuffers, int _nMaxClients, size_t _nMaxFrameSize)
+{
+    if ( _nMaxBuffers <= 0 || _nMaxClients <= 0 ) return nullptr;
+
+    size_t nStride = AlignUp( std::max<size_t>( _nMaxFrameSize, 1 ), CACHE_LINE_SIZE );
+
+    size_t nSize = AlignUp( sizeof( THeader ), CACHE_LINE_SIZE )
+                 + sizeof( TClient ) * _nMaxClients
+                 + sizeof( TSlot ) * _nMaxBuffers
+                 + nStride * _nMaxBuffers;
+
+    int fd = shm_open( _Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+
+    if ( fd < 0 ) return nullptr;
+
+    void* pSegment = MAP_FAILED;
+
+    if ( ftruncate( fd, nSize ) == 0 )
+    {
+        pSegment = mmap( nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+
+    if ( pSegment == MAP_FAILED )
+    {
+        shm_unlink( _Name.c_str() );
+
+        return nullptr;
+    }
+
+    auto pHeader = new (pSegment) THeader();
+
+    pHeader->nSegmentSize = nSize;
+    pHeader->nMaxFrameSize = _nMaxFrameSize;
+    pHeader->nFrameStride = nStride;
+    pHeader->nMaxBuffers = _nMaxBuffers;
+    pHeader->nMaxClients = _nMaxClients;
+
+    auto pSplitter = std::shared_ptr<ISplitterShm>( new ISplitterShm( pSegment, nSize, _Name, true ) );
+
+    for ( int i = 0; i < _nMaxClients; i++ )
+    {
+        new (&pSplitter->m_pClients[i]) TClient();
+    }
+
+    for ( int i = 0; i < _nMaxBuffers; i++ )
+    {
+        new (&pSplitter->m_pSlots[i]) TSlot();
+    }
+
+    pHeader->nMagic.store( SHM_MAGIC, std::memory_order_release );
+
+    return pSplitter;
+}
+
+std::shared_ptr<ISplitterShm> ISplitterShm::Attach(const std::string& _Name)
+{
+    int fd = shm_open( _Name.c_str(), O_RDWR, 0 );
+
+    if ( fd < 0 ) return nullptr;
+
+    struct stat st;
+
+    void* pSegment = MAP_FAILED;
+
+    if ( fstat( fd, &st ) == 0 && static_cast<size_t>( st.st_size ) >= sizeof( THeader ) )
+    {
+        pSegment = mmap( nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+
+    if ( pSegment == MAP_FAILED ) return nullptr;
+
+    auto pHeader = static_cast<THeader*>( pSegment );
+
+    if ( pHeader->nMagic.load( std::memory_order_acquire ) != SHM_MAGIC || pHeader->nSegmentSize != static_cast<size_t>( st.st_size ) )
+    {
+        munmap( pSegment, st.st_size );
+
+        return nullptr;
+    }
+
+    return std::shared_ptr<ISplitterShm>( new ISplitterShm( pSegment, st.st_size, _Name, false ) );
+}
+
+ISplitterShm::ISplitterShm(void* _pSegment, size_t _nSize, const std::string& _Name, bool _bOwner)
+    : m_pSegment(_pSegment)
+    , m_nSize(_nSize)
+    , m_Name(_Name)
+    , m_bOwner(_bOwner)
+{
+    auto pBase = static_cast<uint8_t*>( _pSegment );
+
+    m_pHeader = static_cast<THeader*>( _pSegment );
+
+    pBase += AlignUp( sizeof( THeader ), CACHE_LINE_SIZE );
+
+    m_pClients = reinterpret_cast<TClient*>( pBase );
+
+    pBase += sizeof( TClient ) * m_pHeader->nMaxClients;
+
+    m_pSlots = reinterpret_cast<TSlot*>( pBase );
+
+    pBase += sizeof( TSlot ) * m_pHeader->nMaxBuffers;
+
+    m_pPayload = pBase;
+}
+
+ISplitterShm::~ISplitterShm()
+{
+    if ( m_bOwner )
+    {
+        SplitterClose();
+
+        // attached processes keep their mappings
+        shm_unlink( m_Name.c_str() );
+    }
+    munmap( m_pSegment, m_nSize );
+}
+
+bool    ISplitterShm::SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients)
+{
+    if ( m_pHeader->bClosed ) return false;
+
+    *_pnMaxBuffers = m_pHeader->nMaxBuffers;
+    *_pnMaxClients = m_pHeader->nMaxClients;
+
+    return true;
+}
+
+// Копируем кадр в разделяемую память, ждём медленных клиентов, как ISplitter::SplitterPut.
+// Только в создавшем сплиттер процессе (иначе ERR_NOT_OWNER) и только из одного потока. Кадр больше
+// _nMaxFrameSize не кладём, возвращаем ERR_FRAME_TOO_LARGE.
+int    ISplitterShm::SplitterPut(IN const uint8_t* _pData, IN size_t _nSize, IN int _nTimeOutMsec)
+{
+    if ( m_pHeader->bClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+    if ( not m_bOwner ) return ISplitter::ERR_NOT_OWNER;
+
+    // the slots were sized at creation
+    if ( _nSize > m_pHeader->nMaxFrameSize ) return ISplitter::ERR_FRAME_TOO_LARGE;
+
+    auto deadline = std::chrono::steady_clock::now() + _nTimeOutMsec*1ms;
+
+    int res = 0;
+
+    if ( m_pHeader->nEnd.load() - m_pHeader->nBegin.load() >= m_pHeader->nMaxBuffers )
+    {
+        res = RemoveOldestFrame( deadline );
+
+        if ( res == ISplitter::ERR_SPLITTER_IS_CLOSED ) return res;
+    }
+
+    TFrameSeq nSeq = m_pHeader->nEnd.load();
+
+    auto& slot = Slot( nSeq );
+
+    // a client still reading the removed frame in this slot sees the number change
+    slot.nSeq.store( NO_FRAME, std::memory_order_relaxed );
+
+    std::atomic_thread_fence( std::memory_order_release );
+
+    std::memcpy( Payload( nSeq ), _pData, _nSize );
+
+    slot.nSize.store( _nSize, std::memory_order_relaxed );
+    slot.nSeq.store( nSeq, std::memory_order_release );
+
+    m_pHeader->nEnd.store( nSeq + 1 );
+
+    // waiters announce themselves before they look at the end, we bump the word after moving it
+    m_pHeader->nNewFrame.fetch_add( 1 );
+
+    if ( m_pHeader->nGetWaiters.load() > 0 ) SplitterFutexWake( m_pHeader->nNewFrame, true );
+
+    return res;
+}
+
+int    ISplitterShm::RemoveOldestFrame(std::chrono::steady_clock::time_point _Deadline)
+{
+    // wait for slow
+
+    if ( HasSlowClients() && ( ReapDeadClients() == 0 || HasSlowClients() ) )
+    {
+        m_pHeader->nPutWaiters.fetch_add( 1 );
+
+        while ( not m_pHeader->bClosed && std::chrono::steady_clock::now() < _Deadline )
+        {
+            uint32_t nSpace = m_pHeader->nSpace.load();
+
+            if ( not HasSlowClients() ) break;
+
+            auto wake = std::min( _Deadline, std::chrono::steady_clock::now() + REAP_INTERVAL );
+
+            SplitterFutexWait( m_pHeader->nSpace, nSpace, wake, true );
+
+            if ( std::chrono::steady_clock::now() >= wake ) ReapDeadClients();
+        }
+
+        m_pHeader->nPutWaiters.fetch_sub( 1 );
+
+        if ( m_pHeader->bClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+    }
+
+    // remove last frame
+
+    TFrameSeq nOldest = m_pHeader->nBegin.load();
+
+    int res = 0;
+
+    for ( uint32_t i = 0; i < m_pHeader->nMaxClients; i++ )
+    {
+        auto& client = m_pClients[i];
+
+        TFrameSeq nFrame = nOldest;
+
+        // the payload stays readable until the slot is reused, the client validates what it read
+        if ( client.nNextFrame.compare_exchange_strong( nFrame, nOldest + 1 ) )
+        {
+            client.nDropped.fetch_add( 1, std::memory_order_relaxed );
+
+            res = ISplitter::ERR_FORCED_FRAMES_REMOVE;
+        }
+    }
+
+    m_pHeader->nBegin.store( nOldest + 1 );
+
+    return res;
+}
+
+bool    ISplitterShm::HasSlowClients()
+{
+    TFrameSeq nOldest = m_pHeader->nBegin.load();
+
+    for ( uint32_t i = 0; i < m_pHeader->nMaxClients; i++ )
+    {
+        if ( m_pClients[i].nNextFrame.load() == nOldest ) return true;
+    }
+    return false;
+}
+
+int    ISplitterShm::ReapDeadClients()
+{
+    int nReaped = 0;
+
+    for ( uint32_t i = 0; i < m_pHeader->nMaxClients; i++ )
+    {
+        auto& client = m_pClients[i];
+
+        if ( client.eState.load() != TClient::ACTIVE ) continue;
+
+        // EPERM: alive, just not ours to signal
+        if ( kill( client.nPid.load(), 0 ) == 0 || errno != ESRCH ) continue;
+
+        uint32_t eState = TClient::ACTIVE;
+
+        if ( not client.eState.compare_exchange_strong( eState, TClient::INIT ) ) continue;
+
+        client.nNextFrame.store( NO_FRAME );
+
+        client.eState.store( TClient::FREE );
+
+        nReaped++;
+    }
+    return nReaped;
+}
+
+bool    ISplitterShm::SplitterClientAdd(OUT int* _pnClientID)
+{
+    if ( m_pHeader->bClosed ) return false;
+
+    for ( uint32_t i = 0; i < m_pHeader->nMaxClients; i++ )
+    {
+        auto& client = m_pClients[i];
+
+        uint32_t eState = TClient::FREE;
+
+        if ( not client.eState.compare_exchange_strong( eState, TClient::INIT ) ) continue;
+
+        client.nPid.store( getpid() );
+        client.nHeld.store( NO_FRAME );
+        client.nDropped.store( 0 );
+        client.nDroppedReported.store( 0 );
+        client.nNextFrame.store( m_pHeader->nEnd.load() );
+
+        client.eState.store( TClient::ACTIVE );
+
+        *_pnClientID = i + 1;
+
+        return true;
+    }
+    return false;
+}
+
+bool    ISplitterShm::SplitterClientRemove(IN int _nClientID)
+{
+    if ( m_pHeader->bClosed ) return false;
+
+    auto pClient = FindClient( _nClientID );
+
+    if ( pClient == nullptr ) return false;
+
+    uint32_t eState = TClient::ACTIVE;
+
+    if ( not pClient->eState.compare_exchange_strong( eState, TClient::INIT ) ) return false;
+
+    pClient->nNextFrame.store( NO_FRAME );
+
+    pClient->eState.store( TClient::FREE );
+
+    // the producer may wait for this client, the client may wait for a frame
+    m_pHeader->nSpace.fetch_add( 1 );
+
+    SplitterFutexWake( m_pHeader->nSpace, true );
+
+    m_pHeader->nNewFrame.fetch_add( 1 );
+
+    SplitterFutexWake( m_pHeader->nNewFrame, true );
+
+    return true;
+}
+
+bool    ISplitterShm::SplitterClientGetCount(OUT int* _pnCount)
+{
+    if ( m_pHeader->bClosed ) return false;
+
+    *_pnCount = 0;
+
+    for ( uint32_t i = 0; i < m_pHeader->nMaxClients; i++ )
+    {
+        if ( m_pClients[i].eState.load() == TClient::ACTIVE ) (*_pnCount)++;
+    }
+    return true;
+}
+
+// Отпускаем кадр, выданный прошлым вызовом, и выдаём следующий, ждём его _nTimeOutMsec. В _pnSkipped -
+// сколько кадров клиент пропустил с прошлого успешного вызова.
+int    ISplitterShm::SplitterGet(IN int _nClientID, OUT TShmFrame& _Frame, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped)
+{
+    if ( m_pHeader->bClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+    auto pClient = FindClient( _nClientID );
+
+    if ( pClient == nullptr ) return ISplitter::ERR_BAD_CLIENT_ID;
+
+    auto& client = *pClient;
+
+    // release the frame handed out last time, unless the producer has already taken it away
+    TFrameSeq nHeld = client.nHeld.exchange( NO_FRAME );
+
+    if ( nHeld != NO_FRAME )
+    {
+        TFrameSeq nFrame = nHeld;
+
+        if ( client.nNextFrame.compare_exchange_strong( nFrame, nHeld + 1 )
+             && nHeld == m_pHeader->nBegin.load() && m_pHeader->nPutWaiters.load() > 0 )
+        {
+            m_pHeader->nSpace.fetch_add( 1 );
+
+            SplitterFutexWake( m_pHeader->nSpace, true );
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + _nTimeOutMsec*1ms;
+
+    while ( true )
+    {
+        TFrameSeq nFrame = client.nNextFrame.load();
+
+        TFrameSeq nBegin = m_pHeader->nBegin.load();
+
+        if ( nFrame < nBegin )
+        {
+            if ( client.nNextFrame.compare_exchange_strong( nFrame, nBegin ) ) client.nDropped.fetch_add( nBegin - nFrame );
+
+            continue;
+        }
+
+        if ( nFrame < m_pHeader->nEnd.load() )
+        {
+            auto& slot = Slot( nFrame );
+
+            // being rewritten: the frame is already out of the buffer
+            if ( slot.nSeq.load( std::memory_order_acquire ) != nFrame ) continue;
+
+            client.nHeld.store( nFrame );
+
+            _Frame.pData = Payload( nFrame );
+            _Frame.nSize = slot.nSize.load( std::memory_order_relaxed );
+            _Frame.nSeq = nFrame;
+
+            if ( _pnSkipped )
+            {
+                uint64_t nDropped = client.nDropped.load();
+
+                *_pnSkipped = nDropped - client.nDroppedReported.exchange( nDropped );
+            }
+            return 0;
+        }
+
+        if ( std::chrono::steady_clock::now() >= deadline ) return ISplitter::ERR_TIMEOUT;
+
+        // announced first, checked second: a frame put meanwhile either is seen here or changes the word
+        m_pHeader->nGetWaiters.fetch_add( 1 );
+
+        uint32_t nNewFrame = m_pHeader->nNewFrame.load();
+
+        bool bReady = m_pHeader->bClosed || client.eState.load() != TClient::ACTIVE || client.nNextFrame.load() < m_pHeader->nEnd.load();
+
+        if ( not bReady ) SplitterFutexWait( m_pHeader->nNewFrame, nNewFrame, deadline, true );
+
+        m_pHeader->nGetWaiters.fetch_sub( 1 );
+
+        if ( m_pHeader->bClosed ) return ISplitter::ERR_SPLITTER_IS_CLOSED;
+
+        if ( client.eState.load() != TClient::ACTIVE ) return ISplitter::ERR_BAD_CLIENT_ID;
+    }
+}
+
+// Данные кадра не перезаписаны: всё, что прочитано из _Frame.pData до этого вызова, верно
+bool    ISplitterShm::SplitterFrameValid(IN const TShmFrame& _Frame)
+{
+    if ( _Frame.pData == nullptr ) return false;
+
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    return Slot( _Frame.nSeq ).nSeq.load( std::memory_order_relaxed ) == _Frame.nSeq;
+}
+
+// Закрываем сплиттер для всех процессов, все ожидания прерываются
+void    ISplitterShm::SplitterClose()
+{
+    m_pHeader->bClosed.store( 1 );
+
+    m_pHeader->nNewFrame.fetch_add( 1 );
+
+    SplitterFutexWake( m_pHeader->nNewFrame, true );
+
+    m_pHeader->nSpace.fetch_add( 1 );
+
+    SplitterFutexWake( m_pHeader->nSpace, true );
+}
+
+ISplitterShm::TClient* ISplitterShm::FindClient(int _nClientID)
+{
+    if ( _nClientID < 1 || static_cast<uint32_t>( _nClientID ) > m_pHeader->nMaxClients ) return nullptr;
+
+    auto pClient = &m_pClients[_nClientID - 1];
+
+    if ( pClient->eState.load() != TClient::ACTIVE ) return nullptr;
+
+    return pClient;
+}
+
+ISplitterShm::TSlot& ISplitterShm::Slot(TFrameSeq _nSeq)
+{
+    return m_pSlots[ _nSeq % m_pHeader->nMaxBuffers ];
+}
+
+uint8_t* ISplitterShm::Payload(TFrameSeq _nSeq)
+{
+    return m_pPayload + ( _nSeq % m_pHeader->nMaxBuffers ) * m_pHeader->nFrameStride;
+}
@@ -0,0 +1,88 @@
+#ifndef SPLITTER_SHM_H
+#define SPLITTER_SHM_H
+
+#include "splitter.h"
+
+#include <string>
+
+// Кадр, выданный ISplitterShm::SplitterGet: указатель прямо в разделяемую память, без копирования.
+// Действителен до следующего SplitterGet этого клиента, но если клиент держит его дольше, чем кладущий
+// процесс ждёт медленных клиентов, кадр удаляется, а ячейку занимает новый. Поэтому прочитанные данные
+// подтверждаем SplitterFrameValid.
+struct TShmFrame
+{
+    const uint8_t* pData{nullptr};
+    size_t nSize{0};
+    TFrameSeq nSeq{0};
+};
+
+// Сплиттер между процессами. Очередь кадров, сами кадры и позиции клиентов лежат в именованном сегменте
+// разделяемой памяти (shm_open), ожидания - на futex в этом же сегменте. Процесс, создавший сплиттер
+// (Create), кладёт кадры, как ISplitter в режиме MODE_SINGLE_PRODUCER с OVERFLOW_BLOCK; процессы-клиенты
+// подключаются по имени (Attach) и забирают кадры без копирования. Коды ошибок - ISplitter::ErrorCode.
+// Кадр не больше _nMaxFrameSize, ячейки под кадры выделяются при создании. Клиент, чей процесс завершился
+// без SplitterClientRemove, удаляется, когда кладущий процесс начинает его ждать (по pid клиента, поэтому
+// процессы должны видеть друг друга в одном pid namespace).
+class ISplitterShm
+{
+public:
+
+    // Создаём сегмент _Name (вида "/name"), его удаляет объект, который его создал
+    static std::shared_ptr<ISplitterShm> Create(const std::string& _Name, int _nMaxBuffers, int _nMaxClients, size_t _nMaxFrameSize);
+
+    // Подключаемся к сегменту, созданному другим процессом
+    static std::shared_ptr<ISplitterShm> Attach(const std::string& _Name);
+
+    ~ISplitterShm();
+
+    bool    SplitterInfoGet(OUT int* _pnMaxBuffers, OUT int* _pnMaxClients);
+
+    // Копируем кадр в разделяемую память, ждём медленных клиентов, как ISplitter::SplitterPut.
+    // Только в создавшем сплиттер процессе (иначе ERR_NOT_OWNER) и только из одного потока. Кадр больше
+    // _nMaxFrameSize не кладём, возвращаем ERR_FRAME_TOO_LARGE.
+    int     SplitterPut(IN const uint8_t* _pData, IN size_t _nSize, IN int _nTimeOutMsec);
+
+    bool    SplitterClientAdd(OUT int* _pnClientID);
+
+    bool    SplitterClientRemove(IN int _nClientID);
+
+    bool    SplitterClientGetCount(OUT int* _pnCount);
+
+    // Отпускаем кадр, выданный прошлым вызовом, и выдаём следующий, ждём его _nTimeOutMsec. В _pnSkipped -
+    // сколько кадров клиент пропустил с прошлого успешного вызова.
+    int     SplitterGet(IN int _nClientID, OUT TShmFrame& _Frame, IN int _nTimeOutMsec, OUT uint64_t* _pnSkipped = nullptr);
+
+    // Данные кадра не перезаписаны: всё, что прочитано из _Frame.pData до этого вызова, верно
+    bool    SplitterFrameValid(IN const TShmFrame& _Frame);
+
+    // Закрываем сплиттер для всех процессов, все ожидания прерываются
+    void    SplitterClose();
+
+private:
+
+    struct THeader;
+    struct TClient;
+    struct TSlot;
+
+    ISplitterShm(void* _pSegment, size_t _nSize, const std::string& _Name, bool _bOwner);
+
+    TClient* FindClient(int _nClientID);
+    TSlot&   Slot(TFrameSeq _nSeq);
+    uint8_t* Payload(TFrameSeq _nSeq);
+
+    bool    HasSlowClients();
+    int     ReapDeadClients();
+    int     RemoveOldestFrame(std::chrono::steady_clock::time_point _Deadline);
+
+    void*       m_pSegment{nullptr};
+    size_t      m_nSize{0};
+    std::string m_Name;
+    bool        m_bOwner{false};
+
+    THeader*    m_pHeader{nullptr};
+    TClient*    m_pClients{nullptr};
+    TSlot*      m_pSlots{nullptr};
+    uint8_t*    m_pPayload{nullptr};
+};
+
+#endif /*SPLITTER_SHM_H*/
@@ -0,0 +1,206 @@
+#include "splitter_trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <thread>
+
+std::atomic<bool> ISplitterTrace::s_bEnabled{false};
+
+namespace
+{
+
+// Single producer (the owning thread), single consumer (the drainer)
+struct TThreadRing
+{
+    static constexpr size_t SIZE = 4096;
+
+    std::unique_ptr<TTraceRecord[]> pRecords{ new TTraceRecord[SIZE] };
+    uint32_t nThread{0};
+    std::atomic<bool> bOwnerGone{false};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> nHead{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> nTail{0};
+};
+
+typedef std::shared_ptr<TThreadRing> TThreadRingPtr;
+
+struct TTraceState
+{
+    std::mutex ControlMutex;    // Start / Stop
+
+    std::mutex Mutex;           // the fields below
+    std::condition_variable Stop;
+    std::vector<TThreadRingPtr> Rings;
+    uint32_t nThreads{0};
+    bool bStop{false};
+    std::thread Drainer;
+
+    std::atomic<uint64_t> nLost{0};
+};
+
+TTraceState& State()
+{
+    static TTraceState state;
+
+    return state;
+}
+
+// the ring outlives its thread until the drainer has taken everything from it
+struct TThreadRingOwner
+{
+    TThreadRingPtr pRing;
+
+    ~TThreadRingOwner()
+    {
+        if ( pRing ) pRing->bOwnerGone.store( true, std::memory_order_release );
+    }
+};
+
+thread_local TThreadRingOwner t_Ring;
+
+TThreadRing& ThreadRing()
+{
+    if ( not t_Ring.pRing )
+    {
+        auto& state = State();
+
+        auto pRing = std::make_shared<TThreadRing>();
+
+        std::lock_guard<std::mutex> locker( state.Mutex );
+
+        pRing->nThread = ++state.nThreads;
+
+        state.Rings.push_back( pRing );
+
+        t_Ring.pRing = std::move( pRing );
+    }
+    return *t_Ring.pRing;
+}
+
+void Drain( std::vector<TTraceRecord>& _Records )
+{
+    auto& state = State();
+
+    std::lock_guard<std::mutex> locker( state.Mutex );
+
+    for ( auto it = state.Rings.begin(); it != state.Rings.end(); )
+    {
+        auto& ring = **it;
+
+        bool bOwnerGone = ring.bOwnerGone.load( std::memory_order_acquire );
+
+        uint64_t head = ring.nHead.load( std::memory_order_acquire );
+        uint64_t tail = ring.nTail.load( std::memory_order_relaxed );
+
+        for ( ; tail != head; tail++ )
+        {
+            _Records.push_back( ring.pRecords[ tail & ( TThreadRing::SIZE - 1 ) ] );
+        }
+        ring.nTail.store( tail, std::memory_order_release );
+
+        it = bOwnerGone ? state.Rings.erase( it ) : it + 1;
+    }
+}
+
+}
+
+bool ISplitterTrace::Start( TTraceSink _Sink, int _nPeriodMsec )
+{
+    auto& state = State();
+
+    std::lock_guard<std::mutex> control_locker( state.ControlMutex );
+
+    if ( state.Drainer.joinable() or not _Sink ) return false;
+
+    state.bStop = false;
+
+    state.Drainer = std::thread( [Sink = std::move( _Sink ), period = std::chrono::milliseconds( std::max( _nPeriodMsec, 1 ) )] {
+        auto& state = State();
+
+        std::vector<TTraceRecord> records;
+
+        bool bStop = false;
+
+        while ( not bStop )
+        {
+            {
+                std::unique_lock<std::mutex> locker( state.Mutex );
+
+                bStop = state.Stop.wait_for( locker, period, [&state] { return state.bStop; } );
+            }
+
+            records.clear();
+
+            Drain( records );
+
+            if ( not records.empty() ) Sink( records.data(), records.size() );
+        }
+    });
+
+    s_bEnabled.store( true );
+
+    return true;
+}
+
+void ISplitterTrace::Stop()
+{
+    auto& state = State();
+
+    std::lock_guard<std::mutex> control_locker( state.ControlMutex );
+
+    if ( not state.Drainer.joinable() ) return;
+
+    s_bEnabled.store( false );
+
+    {
+        std::lock_guard<std::mutex> locker( state.Mutex );
+
+        state.bStop = true;
+    }
+    state.Stop.notify_all();
+
+    state.Drainer.join();
+}
+
+TTraceSink ISplitterTrace::FileSink( const std::string& _Path )
+{
+    std::shared_ptr<FILE> pFile( std::fopen( _Path.c_str(), "ab" ), [] ( FILE* _pFile ) { if ( _pFile ) std::fclose( _pFile ); } );
+
+    return [pFile] ( const TTraceRecord* _pRecords, size_t _nRecords ) {
+        if ( not pFile ) return;
+
+        std::fwrite( _pRecords, sizeof( TTraceRecord ), _nRecords, pFile.get() );
+
+        std::fflush( pFile.get() );
+    };
+}
+
+void ISplitterTrace::Record( TTraceEvent _eEvent, uint64_t _nArg0, uint64_t _nArg1 )
+{
+    auto& ring = ThreadRing();
+
+    uint64_t head = ring.nHead.load( std::memory_order_relaxed );
+
+    if ( head - ring.nTail.load( std::memory_order_acquire ) == TThreadRing::SIZE )
+    {
+        State().nLost.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    auto& record = ring.pRecords[ head & ( TThreadRing::SIZE - 1 ) ];
+
+    record.nTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    record.nArg0 = _nArg0;
+    record.nArg1 = _nArg1;
+    record.nThread = ring.nThread;
+    record.eEvent = _eEvent;
+    record.nReserved = 0;
+
+    ring.nHead.store( head + 1, std::memory_order_release );
+}
+
+uint64_t ISplitterTrace::Lost()
+{
+    return State().nLost.load( std::memory_order_relaxed );
+}
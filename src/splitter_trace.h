@@ -0,0 +1,71 @@
+#ifndef SPLITTER_TRACE_H
+#define SPLITTER_TRACE_H
+
+#include "splitter_definitions.h"
+
+#include <string>
+
+// Трассировка горячего пути сплиттера. Событие - запись фиксированного размера без строк: поток кладёт её
+// в свой кольцевой буфер без блокировок, фоновый поток забирает записи и отдаёт их приёмнику (TTraceSink).
+// Если буфер потока полон, запись теряется, а не ждёт. Сборка без SPLITTER_TRACE_ENABLED (опция CMake
+// SPLITTER_TRACE) превращает SPLITTER_TRACE в пустой оператор, аргументы не вычисляются.
+
+enum TTraceEvent : uint16_t
+{
+    TRACE_PUT=1             // кадр в очереди: номер кадра, размер
+    ,TRACE_DROP_NEW         // OVERFLOW_DROP_NEWEST: новый кадр не положили
+    ,TRACE_WAKE_CLIENTS     // будим ждущих клиентов: сколько их
+    ,TRACE_WAIT_SLOW        // ждём медленных клиентов: номер самого старого кадра
+    ,TRACE_REMOVE_OLDEST    // удалили самый старый кадр: номер, сколько клиентов его пропустили
+    ,TRACE_WAIT_FRAME       // клиент ждёт кадр: клиент, номер ожидаемого кадра
+    ,TRACE_GET              // клиент забрал кадры: клиент, сколько кадров ещё не прочитано
+    ,TRACE_NOTIFY_PRODUCER  // клиент отпустил самый старый кадр: клиент, номер кадра
+};
+
+struct TTraceRecord
+{
+    uint64_t nTimeNs;   // steady_clock
+    uint64_t nArg0;
+    uint64_t nArg1;
+    uint32_t nThread;   // порядковый номер потока, с 1
+    uint16_t eEvent;    // TTraceEvent
+    uint16_t nReserved;
+};
+
+// Получает записи пачками в фоновом потоке, записи одного потока идут в порядке их появления
+typedef std::function<void(const TTraceRecord* _pRecords, size_t _nRecords)> TTraceSink;
+
+class ISplitterTrace
+{
+public:
+
+    // Включаем запись событий и запускаем фоновый поток, который раз в _nPeriodMsec отдаёт их _Sink.
+    // false, если трассировка уже запущена.
+    static bool Start( TTraceSink _Sink, int _nPeriodMsec = 10 );
+
+    // Выключаем запись, отдаём приёмнику оставшиеся записи и останавливаем фоновый поток
+    static void Stop();
+
+    // Приёмник, дописывающий записи как есть в двоичный файл _Path
+    static TTraceSink FileSink( const std::string& _Path );
+
+    static bool Enabled() { return s_bEnabled.load( std::memory_order_relaxed ); };
+
+    static void Record( TTraceEvent _eEvent, uint64_t _nArg0, uint64_t _nArg1 );
+
+    // Сколько записей потеряно из-за переполнения буферов потоков
+    static uint64_t Lost();
+
+private:
+
+    static std::atomic<bool> s_bEnabled;
+};
+
+#ifdef SPLITTER_TRACE_ENABLED
+#define SPLITTER_TRACE(_eEvent, _nArg0, _nArg1) \
+    do { if ( ISplitterTrace::Enabled() ) ISplitterTrace::Record( (_eEvent), (_nArg0), (_nArg1) ); } while (0)
+#else
+#define SPLITTER_TRACE(_eEvent, _nArg0, _nArg1) do { } while (0)
+#endif
+
+#endif /*SPLITTER_TRACE_H*/
@@ -0,0 +1,83 @@
+#include "splitter_wait.h"
+
+#include <algorithm>
+#include <climits>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+void SplitterFutexWait( std::atomic<uint32_t>& _Word, uint32_t _nValue, std::chrono::steady_clock::time_point _Deadline, bool _bShared )
+{
+    auto left = _Deadline - std::chrono::steady_clock::now();
+
+    if ( left <= 0ns ) return;
+
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>( left );
+
+    timespec timeout{ static_cast<time_t>( sec.count() ), static_cast<long>( std::chrono::nanoseconds( left - sec ).count() ) };
+
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &_Word ), _bShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, _nValue, &timeout, nullptr, 0 );
+}
+
+void SplitterFutexWake( std::atomic<uint32_t>& _Word, bool _bShared )
+{
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &_Word ), _bShared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0 );
+}
+
+// Two threads hand a token back and forth through futexes: each handoff is one sleep and one wakeup
+static uint64_t MeasureParkCostNs()
+{
+    const int nRounds = 100;
+
+    std::atomic<uint32_t> token{0};
+
+    auto WaitFor = [&] ( uint32_t _nValue ) {
+        uint32_t value;
+
+        while ( ( value = token.load() ) != _nValue )
+        {
+            SplitterFutexWait( token, value, std::chrono::steady_clock::now() + 100ms );
+        }
+    };
+
+    auto Pass = [&] ( uint32_t _nValue ) {
+        token.store( _nValue );
+
+        SplitterFutexWake( token );
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread echo( [&] {
+        for ( uint32_t i = 0; i < nRounds; i++ )
+        {
+            WaitFor( 2*i + 1 );
+
+            Pass( 2*i + 2 );
+        }
+    });
+
+    for ( uint32_t i = 0; i < nRounds; i++ )
+    {
+        Pass( 2*i + 1 );
+
+        WaitFor( 2*i + 2 );
+    }
+
+    echo.join();
+
+    uint64_t nNs = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+
+    // a scheduler hiccup must not make us spin for milliseconds
+    return std::clamp<uint64_t>( nNs / ( 2*nRounds ), 1000, 100000 );
+}
+
+uint64_t SplitterParkCostNs()
+{
+    static const uint64_t nCostNs = MeasureParkCostNs();
+
+    return nCostNs;
+}
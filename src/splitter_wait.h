@@ -0,0 +1,134 @@
+#ifndef SPLITTER_WAIT_H
+#define SPLITTER_WAIT_H
+
+#include "splitter_definitions.h"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Пауза в цикле ожидания: крутящийся поток не забивает конвейер и не мешает соседнему гиперпотоку
+inline void SplitterCpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile( "yield" );
+#endif
+}
+
+// Ждём _Ready() до _Deadline, не засыпая: между проверками - пауза процессора или, с _bYield, отдаём
+// процессор другим потокам. Возвращаем _Ready().
+template <class TReady>
+bool SplitterSpinUntil( std::chrono::steady_clock::time_point _Deadline, bool _bYield, TReady _Ready )
+{
+    for ( unsigned i = 1; ; i++ )
+    {
+        if ( _Ready() ) return true;
+
+        if ( _bYield ) std::this_thread::yield(); else SplitterCpuRelax();
+
+        // the clock costs more than a pause, read it now and then
+        if ( ( _bYield || i % 64 == 0 ) && std::chrono::steady_clock::now() >= _Deadline ) return _Ready();
+    }
+}
+
+// Спим, пока слово _Word равно _nValue, но не дольше _Deadline, и будим спящих на нём.
+// _bShared - слово в памяти, общей с другими процессами.
+void SplitterFutexWait( std::atomic<uint32_t>& _Word, uint32_t _nValue, std::chrono::steady_clock::time_point _Deadline, bool _bShared = false );
+void SplitterFutexWake( std::atomic<uint32_t>& _Word, bool _bShared = false );
+
+// Сколько стоит заснуть на futex и проснуться от другого потока, измеряется при первом вызове.
+// Дольше крутиться перед сном нет смысла: ожидание уже обошлось бы дороже сна.
+uint64_t SplitterParkCostNs();
+
+// Стратегии ожидания для TSplitterEvent и BasicSplitter, те же, что ISplitter::WaitStrategy:
+// Spin ждёт условия, не засыпая, PARKS - после этого можно заснуть на futex.
+
+struct TBlockWait
+{
+    static constexpr bool PARKS = true;
+
+    template <class TReady>
+    static bool Spin( std::chrono::steady_clock::time_point, TReady ) { return false; };
+};
+
+struct TSpinWait
+{
+    static constexpr bool PARKS = false;
+
+    template <class TReady>
+    static bool Spin( std::chrono::steady_clock::time_point _Deadline, TReady _Ready ) { return SplitterSpinUntil( _Deadline, false, _Ready ); };
+};
+
+struct TYieldWait
+{
+    static constexpr bool PARKS = false;
+
+    template <class TReady>
+    static bool Spin( std::chrono::steady_clock::time_point _Deadline, TReady _Ready ) { return SplitterSpinUntil( _Deadline, true, _Ready ); };
+};
+
+struct TAdaptiveWait
+{
+    static constexpr bool PARKS = true;
+
+    template <class TReady>
+    static bool Spin( std::chrono::steady_clock::time_point _Deadline, TReady _Ready )
+    {
+        auto spinEnd = std::chrono::steady_clock::now() + std::chrono::nanoseconds( SplitterParkCostNs() );
+
+        return SplitterSpinUntil( std::min( _Deadline, spinEnd ), false, _Ready );
+    };
+};
+
+// Событие, которого ждут под блокировкой: номер изменения читается под ней, а ждём, отпустив её, смены
+// номера. Изменение, сделанное под той же блокировкой раньше, видно, сделанное позже - меняет номер.
+// Слово futex вместо condition_variable_any: ни своего мьютекса, ни системного вызова без спящих.
+template <class TWait = TBlockWait>
+class TSplitterEvent
+{
+public:
+
+    template <class TLocker, class TReady>
+    bool Wait( TLocker& _Locker, std::chrono::steady_clock::time_point _Deadline, TReady _Ready )
+    {
+        while ( not _Ready() )
+        {
+            if ( std::chrono::steady_clock::now() >= _Deadline ) return false;
+
+            uint32_t nEpoch = m_nEpoch.load();
+
+            _Locker.unlock();
+
+            if ( not TWait::Spin( _Deadline, [&] { return m_nEpoch.load( std::memory_order_relaxed ) != nEpoch; } ) && TWait::PARKS )
+            {
+                m_nSleepers.fetch_add( 1 );
+
+                SplitterFutexWait( m_nEpoch, nEpoch, _Deadline );
+
+                m_nSleepers.fetch_sub( 1 );
+            }
+
+            _Locker.lock();
+        }
+        return true;
+    };
+
+    void Notify()
+    {
+        m_nEpoch.fetch_add( 1 );
+
+        if ( TWait::PARKS && m_nSleepers.load() > 0 ) SplitterFutexWake( m_nEpoch );
+    };
+
+private:
+
+    std::atomic<uint32_t> m_nEpoch{0};    // futex
+    std::atomic<int> m_nSleepers{0};
+};
+
+#endif /*SPLITTER_WAIT_H*/
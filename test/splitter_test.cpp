@@ -6,6 +6,13 @@
 #include <type_traits>
 #include <thread>
 #include <regex>
+#include <future>
+#include <coroutine>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define CATCH_CONFIG_MAIN
 
@@ -13,7 +20,10 @@
 
 #include "easylogging++.h"
 #include "splitter.h"
+#include "splitter_basic.h"
 #include "splitter_definitions.h"
+#include "splitter_shm.h"
+#include "splitter_trace.h"
 
 using namespace std::chrono_literals;
 
@@ -171,6 +181,354 @@ TEST_CASE( "Splitter", "[splitter]" )
         putter.join();
     }
 
+    SECTION("Frames order")
+    {
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientId) );
+
+        std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+        // several times around the ring, the client keeps up
+        for(int i=0; i<nMaxBufs*3; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 0) == 0 );
+
+            REQUIRE( pSplitter->SplitterGet(nClientId, pFrame, 0) == 0 );
+
+            REQUIRE( pFrame->front() == i );
+        }
+
+        // the client lags, oldest frames are dropped for it
+        for(int i=0; i<nMaxBufs+2; i++)
+        {
+            int res = pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 0);
+
+            REQUIRE( res == ( i < nMaxBufs ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+        }
+
+        REQUIRE( pSplitter->SplitterClientGetByIndex( 0, &nClientId, &nLatency ) );
+
+        REQUIRE( nLatency == nMaxBufs );
+
+        for(int i=2; i<nMaxBufs+2; i++)
+        {
+            REQUIRE( pSplitter->SplitterGet(nClientId, pFrame, 0) == 0 );
+
+            REQUIRE( pFrame->front() == i );
+        }
+        REQUIRE( pSplitter->SplitterGet(nClientId, pFrame, 0) == ISplitter::ERR_TIMEOUT );
+    }
+
+    SECTION("Clients snapshot")
+    {
+        TSplitterClientInfo info[nMaxClients];
+
+        int nCount = -1;
+
+        REQUIRE( pSplitter->SplitterClientsSnapshot( info, nMaxClients, &nCount ) );
+
+        REQUIRE( nCount == 0 );
+
+        for(int i=0; i<3; i++)
+        {
+            REQUIRE( pSplitter->SplitterClientAdd(&nClientId) );
+
+            client[i] = nClientId;
+
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 100 * (i + 1) ), 0) == 0 );
+        }
+
+        std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+        REQUIRE( pSplitter->SplitterGet(client[0], pFrame, 0) == 0 );
+
+        // the first two clients miss the second frame, the oldest one is read already
+        for(int i=0; i<nMaxBufs-1; i++)
+        {
+            pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0);
+        }
+
+        REQUIRE( pSplitter->SplitterClientsSnapshot( info, 2, &nCount ) );
+
+        REQUIRE( nCount == 3 );
+        REQUIRE( info[0].nClientID == client[0] );
+        REQUIRE( info[1].nClientID == client[1] );
+
+        REQUIRE( pSplitter->SplitterClientsSnapshot( info, nMaxClients, &nCount ) );
+
+        REQUIRE( nCount == 3 );
+
+        for(int i=0; i<nCount; i++)
+        {
+            REQUIRE( pSplitter->SplitterClientGetByIndex( i, &nClientId, &nLatency ) );
+
+            REQUIRE( info[i].nClientID == nClientId );
+            REQUIRE( info[i].nLatency == nLatency );
+        }
+
+        REQUIRE( info[0].nLatency == nMaxBufs );
+        REQUIRE( info[0].nLatencyBytes == 300 + nMaxBufs - 1 );
+        REQUIRE( info[0].nDropped == 1 );
+
+        REQUIRE( info[1].nLatency == nMaxBufs );
+        REQUIRE( info[1].nLatencyBytes == 300 + nMaxBufs - 1 );
+        REQUIRE( info[1].nDropped == 1 );
+
+        REQUIRE( info[2].nLatency == nMaxBufs );
+        REQUIRE( info[2].nDropped == 0 );
+    }
+
+    SECTION("Waiting clients")
+    {
+        for(int i=0; i<2; i++)
+        {
+            REQUIRE( pSplitter->SplitterClientAdd(&nClientId) );
+
+            client[i] = nClientId;
+        }
+
+        int res[3] = { -1, -1, -1 };
+
+        auto getLoop = [&](int _nIndex)
+        {
+            std::shared_ptr<std::vector<uint8_t>> pFrameOut;
+
+            res[_nIndex] = pSplitter->SplitterGet(client[_nIndex], pFrameOut, 5000);
+        };
+
+        auto start = std::chrono::steady_clock::now();
+
+        std::thread g1( getLoop, 0 );
+        std::thread g2( getLoop, 1 );
+
+        std::this_thread::sleep_for(50ms);
+
+        // both waiting clients get the frame
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+
+        g1.join();
+        g2.join();
+
+        REQUIRE( res[0] == 0 );
+        REQUIRE( res[1] == 0 );
+
+        // removal interrupts the wait
+        REQUIRE( pSplitter->SplitterClientAdd(&client[2]) );
+
+        std::thread g3( getLoop, 2 );
+
+        std::this_thread::sleep_for(50ms);
+
+        REQUIRE( pSplitter->SplitterClientRemove(client[2]) );
+
+        g3.join();
+
+        REQUIRE( res[2] == ISplitter::ERR_BAD_CLIENT_ID );
+
+        REQUIRE( std::chrono::steady_clock::now() - start < 1s );
+    }
+
+    SECTION("Batch put and get")
+    {
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientId) );
+
+        std::vector<TFramePtr> frames;
+
+        for(int i=0; i<nMaxBufs/2; i++)
+        {
+            frames.push_back( std::make_shared<TFrame>( 1, i ) );
+        }
+
+        REQUIRE( pSplitter->SplitterPutBatch(frames, 0) == 0 );
+
+        REQUIRE( pSplitter->SplitterClientGetByIndex( 0, &nClientId, &nLatency ) );
+
+        REQUIRE( nLatency == nMaxBufs/2 );
+
+        std::vector<TFramePtr> received( 2*nMaxBufs );
+
+        int nReceived = 0;
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientId, std::span( received ).first( 2 ), &nReceived, 0) == 0 );
+
+        REQUIRE( nReceived == 2 );
+        REQUIRE( received[0]->front() == 0 );
+        REQUIRE( received[1]->front() == 1 );
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientId, received, &nReceived, 0) == 0 );
+
+        REQUIRE( nReceived == nMaxBufs/2 - 2 );
+        REQUIRE( received[nReceived - 1]->front() == nMaxBufs/2 - 1 );
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientId, received, &nReceived, 0) == ISplitter::ERR_TIMEOUT );
+
+        REQUIRE( nReceived == 0 );
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientId, {}, &nReceived, 5000) == ISplitter::ERR_TIMEOUT );
+
+        // a batch longer than the buffer pushes its own oldest frames out
+        frames.clear();
+
+        for(int i=0; i<nMaxBufs+3; i++)
+        {
+            frames.push_back( std::make_shared<TFrame>( 1, i ) );
+        }
+
+        REQUIRE( pSplitter->SplitterPutBatch(frames, 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientId, received, &nReceived, 0) == 0 );
+
+        REQUIRE( nReceived == nMaxBufs );
+        REQUIRE( received.front()->front() == 3 );
+        REQUIRE( received[nReceived - 1]->front() == nMaxBufs+2 );
+
+        // a waiting client wakes up with the whole batch
+        std::thread getter( [&] {
+            pSplitter->SplitterGetBatch(nClientId, received, &nReceived, 5000);
+        });
+
+        std::this_thread::sleep_for(50ms);
+
+        frames.resize(3);
+
+        REQUIRE( pSplitter->SplitterPutBatch(frames, 0) == 0 );
+
+        getter.join();
+
+        REQUIRE( nReceived == 3 );
+    }
+
+    SECTION("Frame pool")
+    {
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientId) );
+
+        auto pFrameIn = pSplitter->SplitterFrameAcquire( 1000000 );
+
+        REQUIRE( pFrameIn->size() == 1000000 );
+
+        auto pData = pFrameIn->data();
+
+        REQUIRE( pSplitter->SplitterPut(pFrameIn, 0) == 0 );
+
+        pFrameIn.reset();
+
+        std::shared_ptr<std::vector<uint8_t>> pFrameOut;
+
+        REQUIRE( pSplitter->SplitterGet(nClientId, pFrameOut, 0) == 0 );
+
+        REQUIRE( pFrameOut->data() == pData );
+
+        // still held by the client, a new buffer is needed
+        REQUIRE( pSplitter->SplitterFrameAcquire( 1000000 )->data() != pData );
+
+        pFrameOut.reset();
+
+        // the frame is pushed out of the buffer and released by everybody
+        for(int i=0; i<nMaxBufs; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+        }
+
+        // same size class, the buffer is reused
+        pFrameIn = pSplitter->SplitterFrameAcquire( 600000 );
+
+        REQUIRE( pFrameIn->size() == 600000 );
+        REQUIRE( pFrameIn->data() == pData );
+
+        // other size class
+        REQUIRE( pSplitter->SplitterFrameAcquire( 100 )->data() != pData );
+    }
+
+    SECTION("Reserve and commit")
+    {
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientId) );
+
+        TFrameReservation reservation;
+
+        REQUIRE( pSplitter->SplitterCommit(reservation, 0, 0) == ISplitter::ERR_NO_RESERVATION );
+
+        REQUIRE( pSplitter->SplitterReserve(4096, reservation) );
+
+        REQUIRE( reservation.nSize == 4096 );
+
+        auto pData = reservation.pData;
+
+        std::shared_ptr<std::vector<uint8_t>> pFrameOut;
+
+        const uint8_t header[] = { 1, 2, 3 };
+
+        std::copy( std::begin(header), std::end(header), reservation.pData );
+
+        // more than reserved: refused, the reservation stays for a proper commit
+        REQUIRE( pSplitter->SplitterCommit(reservation, 4097, 0) == ISplitter::ERR_COMMIT_TOO_LARGE );
+
+        REQUIRE( reservation.pData == pData );
+        REQUIRE( reservation.pFrame );
+
+        REQUIRE( pSplitter->SplitterGet(nClientId, pFrameOut, 0) == ISplitter::ERR_TIMEOUT );
+
+        REQUIRE( pSplitter->SplitterCommit(reservation, sizeof(header), 0) == 0 );
+
+        REQUIRE( reservation.pData == nullptr );
+        REQUIRE( not reservation.pFrame );
+
+        REQUIRE( pSplitter->SplitterGet(nClientId, pFrameOut, 0) == 0 );
+
+        // the client reads the very memory the producer wrote to
+        REQUIRE( pFrameOut->data() == pData );
+        REQUIRE( *pFrameOut == std::vector<uint8_t>( std::begin(header), std::end(header) ) );
+
+        pSplitter->SplitterClose();
+
+        REQUIRE_FALSE( pSplitter->SplitterReserve(4096, reservation) );
+    }
+
+    SECTION("Release callback")
+    {
+        int client[2] = {};
+
+        REQUIRE( pSplitter->SplitterClientAdd(&client[0]) );
+        REQUIRE( pSplitter->SplitterClientAdd(&client[1]) );
+
+        int nReleased = 0;
+
+        auto pFrameIn = std::make_shared<TFrame>( 10 );
+
+        REQUIRE( pSplitter->SplitterPut(pFrameIn, [&] { nReleased++; }, 0) == 0 );
+
+        std::shared_ptr<std::vector<uint8_t>> pFrameOut;
+
+        REQUIRE( pSplitter->SplitterGet(client[0], pFrameOut, 0) == 0 );
+
+        REQUIRE( pFrameOut == pFrameIn );
+
+        pFrameOut.reset();
+
+        // the second client has not read it yet
+        REQUIRE( nReleased == 0 );
+
+        REQUIRE( pSplitter->SplitterGet(client[1], pFrameOut, 0) == 0 );
+
+        pFrameOut.reset();
+
+        // both read it: the splitter lets it go at once, not when the queue overflows
+        REQUIRE( nReleased == 1 );
+
+        // our own reference does not count
+        REQUIRE( pFrameIn.use_count() == 1 );
+
+        for(int i=0; i<nMaxBufs; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+        }
+
+        // a frame nobody has read is released by the flush
+        REQUIRE( pSplitter->SplitterPut(pFrameIn, [&] { nReleased++; }, 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        REQUIRE( pSplitter->SplitterFlush() == 0 );
+
+        REQUIRE( nReleased == 2 );
+    }
+
     SECTION("Async")
     {
         std::cout << "Async test" << std::endl;
@@ -243,3 +601,1697 @@ TEST_CASE( "Splitter", "[splitter]" )
     }
     std::cout << "Finish Section" << std::endl;
 }
+
+TEST_CASE( "Single producer", "[splitter]" )
+{
+    const int nMaxClients = 4;
+    const int nMaxBufs = 10;
+
+    auto pSplitter = SplitterCreate(nMaxBufs, nMaxClients, ISplitter::MODE_SINGLE_PRODUCER);
+
+    int client[nMaxClients] = {};
+
+    for(int i=0; i<nMaxClients; i++)
+    {
+        REQUIRE( pSplitter->SplitterClientAdd(&client[i]) );
+    }
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    SECTION("Forced removal")
+    {
+        for(int i=0; i<nMaxBufs+2; i++)
+        {
+            int res = pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 0);
+
+            REQUIRE( res == ( i < nMaxBufs ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+        }
+
+        for(int i=2; i<nMaxBufs+2; i++)
+        {
+            REQUIRE( pSplitter->SplitterGet(client[0], pFrame, 0) == 0 );
+
+            REQUIRE( pFrame->front() == i );
+        }
+        REQUIRE( pSplitter->SplitterGet(client[0], pFrame, 10) == ISplitter::ERR_TIMEOUT );
+
+        REQUIRE( pSplitter->SplitterFlush() == 0 );
+
+        REQUIRE( pSplitter->SplitterGet(client[1], pFrame, 0) == ISplitter::ERR_TIMEOUT );
+
+        std::vector<TFramePtr> frames( nMaxBufs+1, pFrame );
+
+        REQUIRE( pSplitter->SplitterPutBatch(frames, 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        std::vector<TFramePtr> received( 2*nMaxBufs );
+
+        int nReceived = 0;
+
+        REQUIRE( pSplitter->SplitterGetBatch(client[2], received, &nReceived, 0) == 0 );
+
+        REQUIRE( nReceived == nMaxBufs );
+
+        REQUIRE( pSplitter->SplitterClientRemove(client[1]) );
+
+        REQUIRE( pSplitter->SplitterGet(client[1], pFrame, 0) == ISplitter::ERR_BAD_CLIENT_ID );
+    }
+
+    SECTION("Consumers keep every frame in order")
+    {
+        const int nFrames = 2000;
+
+        std::vector<std::vector<int>> received(nMaxClients);
+
+        std::vector<std::thread> getters;
+
+        for(int i=0; i<nMaxClients; i++)
+        {
+            getters.emplace_back( [&, i] {
+                std::shared_ptr<std::vector<uint8_t>> pFrameOut;
+
+                while ( pSplitter->SplitterGet(client[i], pFrameOut, 1000) == 0 )
+                {
+                    received[i].push_back( pFrameOut->front() | pFrameOut->back() << 8 );
+
+                    if ( received[i].size() == nFrames ) break;
+                }
+            });
+        }
+
+        int nPutErrors = 0;
+
+        for(int i=0; i<nFrames; i++)
+        {
+            auto pFrameIn = std::make_shared<TFrame>( 2 );
+
+            pFrameIn->front() = i & 0xff;
+            pFrameIn->back() = i >> 8;
+
+            if ( pSplitter->SplitterPut(pFrameIn, 1000) != 0 ) nPutErrors++;
+        }
+
+        for(auto& getter : getters)
+        {
+            getter.join();
+        }
+
+        REQUIRE( nPutErrors == 0 );
+
+        for(auto& frames : received)
+        {
+            REQUIRE( frames.size() == nFrames );
+
+            for(int i=0; i<nFrames; i++)
+            {
+                REQUIRE( frames[i] == i );
+            }
+        }
+    }
+
+    SECTION("Close interrupts waiting")
+    {
+        std::thread getter( [&] {
+            std::shared_ptr<std::vector<uint8_t>> pFrameOut;
+
+            pSplitter->SplitterGet(client[0], pFrameOut, 10000);
+        });
+
+        std::this_thread::sleep_for(50ms);
+
+        auto start = std::chrono::steady_clock::now();
+
+        pSplitter->SplitterClose();
+
+        getter.join();
+
+        REQUIRE( std::chrono::steady_clock::now() - start < 1s );
+
+        REQUIRE( pSplitter->SplitterGet(client[0], pFrame, 0) == ISplitter::ERR_SPLITTER_IS_CLOSED );
+    }
+}
+
+TEST_CASE( "Overflow policies", "[splitter]" )
+{
+    const int nMaxBufs = 4;
+    const int nFrames = nMaxBufs*3;
+
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    int nFast = 0;
+    int nSlow = 0;
+
+    uint64_t nSkipped = 0;
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    SECTION("Drop oldest for laggards only")
+    {
+        auto pSplitter = SplitterCreate(nMaxBufs, 2, eMode, ISplitter::OVERFLOW_DROP_OLDEST);
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nFast) );
+        REQUIRE( pSplitter->SplitterClientAdd(&nSlow) );
+
+        auto start = std::chrono::steady_clock::now();
+
+        for(int i=0; i<nFrames; i++)
+        {
+            int res = pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 1000);
+
+            REQUIRE( res == ( i < nMaxBufs ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+
+            REQUIRE( pSplitter->SplitterGet(nFast, pFrame, 0, &nSkipped) == 0 );
+
+            REQUIRE( pFrame->front() == i );
+            REQUIRE( nSkipped == 0 );
+        }
+
+        // the producer never waited for the slow client
+        REQUIRE( std::chrono::steady_clock::now() - start < 500ms );
+
+        REQUIRE( pSplitter->SplitterGet(nSlow, pFrame, 0, &nSkipped) == 0 );
+
+        REQUIRE( pFrame->front() == nFrames - nMaxBufs );
+        REQUIRE( nSkipped == nFrames - nMaxBufs );
+
+        REQUIRE( pSplitter->SplitterGet(nSlow, pFrame, 0, &nSkipped) == 0 );
+
+        REQUIRE( nSkipped == 0 );
+    }
+
+    SECTION("Drop newest")
+    {
+        auto pSplitter = SplitterCreate(nMaxBufs, 2, eMode, ISplitter::OVERFLOW_DROP_NEWEST);
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nFast) );
+        REQUIRE( pSplitter->SplitterClientAdd(&nSlow) );
+
+        for(int i=0; i<nFrames; i++)
+        {
+            int res = pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 1000);
+
+            REQUIRE( res == ( i < nMaxBufs ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+        }
+
+        for(int i=0; i<nMaxBufs; i++)
+        {
+            REQUIRE( pSplitter->SplitterGet(nFast, pFrame, 0, &nSkipped) == 0 );
+
+            REQUIRE( pFrame->front() == i );
+            REQUIRE( nSkipped == ( i == 0 ? nFrames - nMaxBufs : 0 ) );
+        }
+
+        // the slow client still holds the oldest frame, new ones keep being dropped
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        std::vector<TFramePtr> frames( nMaxBufs );
+
+        int nReceived = 0;
+
+        REQUIRE( pSplitter->SplitterGetBatch(nSlow, frames, &nReceived, 0, &nSkipped) == 0 );
+
+        REQUIRE( nReceived == nMaxBufs );
+        REQUIRE( nSkipped == nFrames - nMaxBufs + 1 );
+
+        // room again
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, nFrames ), 0) == 0 );
+
+        REQUIRE( pSplitter->SplitterGet(nFast, pFrame, 0, &nSkipped) == 0 );
+
+        REQUIRE( pFrame->front() == nFrames );
+        REQUIRE( nSkipped == 1 );
+    }
+}
+
+TEST_CASE( "Tracing", "[splitter]" )
+{
+    const int nRecords = 1000;
+
+    std::mutex mutex;
+
+    std::vector<TTraceRecord> records;
+
+    REQUIRE( ISplitterTrace::Start( [&] ( const TTraceRecord* _pRecords, size_t _nRecords ) {
+        std::lock_guard<std::mutex> locker( mutex );
+
+        records.insert( records.end(), _pRecords, _pRecords + _nRecords );
+    }, 1 ) );
+
+    REQUIRE_FALSE( ISplitterTrace::Start( [] ( const TTraceRecord*, size_t ) { }, 1 ) );
+
+    auto Writer = [&] ( uint64_t _nArg1 )
+    {
+        for ( int i = 0; i < nRecords; i++ )
+        {
+            ISplitterTrace::Record( TRACE_PUT, i, _nArg1 );
+
+            if ( i % 100 == 0 ) std::this_thread::sleep_for( 1ms );
+        }
+    };
+
+    std::thread first( Writer, 1 );
+    std::thread second( Writer, 2 );
+
+    first.join();
+    second.join();
+
+#ifdef SPLITTER_TRACE_ENABLED
+    auto pSplitter = SplitterCreate(4, 1);
+
+    int nClientID = 0;
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+    // the frame size tells its record from the writers' ones
+    REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 8 ), 0) == 0 );
+    REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0) == 0 );
+#endif
+
+    ISplitterTrace::Stop();
+
+    REQUIRE( ISplitterTrace::Lost() == 0 );
+
+    // every record arrives once, in order within its thread
+    uint64_t next[3] = {0, 0, 0};
+
+    int nSplitterEvents = 0;
+
+    for ( auto& record : records )
+    {
+        if ( record.eEvent != TRACE_PUT || record.nArg1 > 2 || record.nArg1 == 0 )
+        {
+            nSplitterEvents++;
+            continue;
+        }
+        REQUIRE( record.nArg0 == next[record.nArg1]++ );
+    }
+
+    REQUIRE( next[1] == nRecords );
+    REQUIRE( next[2] == nRecords );
+
+#ifdef SPLITTER_TRACE_ENABLED
+    REQUIRE( nSplitterEvents >= 2 );
+#else
+    REQUIRE( nSplitterEvents == 0 );
+#endif
+}
+
+TEST_CASE( "Stats", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    auto pSplitter = SplitterCreate(2, 2, eMode);
+
+    int nFirst = 0;
+    int nSecond = 0;
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nFirst) );
+    REQUIRE( pSplitter->SplitterClientAdd(&nSecond) );
+
+    REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+    REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+
+    REQUIRE( pSplitter->SplitterGet(nFirst, pFrame, 0) == 0 );
+
+    // the second client holds the oldest frame
+    REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 20) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+    std::vector<TFramePtr> frames( 10 );
+
+    int nReceived = 0;
+
+    REQUIRE( pSplitter->SplitterGetBatch(nFirst, frames, &nReceived, 0) == 0 );
+    REQUIRE( nReceived == 2 );
+
+    REQUIRE( pSplitter->SplitterGet(nFirst, pFrame, 10) == ISplitter::ERR_TIMEOUT );
+
+    // counters of removed clients stay in the totals
+    REQUIRE( pSplitter->SplitterClientRemove(nFirst) );
+
+    TSplitterStats stats;
+
+    REQUIRE( pSplitter->SplitterStatsGet(&stats) );
+
+    REQUIRE( stats.nFramesPut == 3 );
+    REQUIRE( stats.nFramesGot == 3 );
+    REQUIRE( stats.nForcedRemovals == 1 );
+    REQUIRE( stats.nTimeouts == 1 );
+    REQUIRE( stats.nSpuriousWakeups == 0 );
+    REQUIRE( stats.nSlowClientsWaitNs >= 15000000 );
+    REQUIRE( stats.nNewFrameWaitNs >= 5000000 );
+
+    // nothing ran concurrently
+    REQUIRE( stats.nExclusiveLockWaits == 0 );
+    REQUIRE( stats.nSharedLockWaits == 0 );
+}
+
+TEST_CASE( "Latency histogram", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    auto pSplitter = SplitterCreate(4, 1, eMode);
+
+    int nClientID = 0;
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    TSplitterLatency latency;
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+    REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+
+    std::this_thread::sleep_for( 20ms );
+
+    REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0) == 0 );
+
+    REQUIRE( pSplitter->SplitterClientLatencyGet(nClientID, &latency) );
+
+    REQUIRE( latency.nCount == 1 );
+    REQUIRE( latency.nMaxNs >= 20000000 );
+    REQUIRE( latency.nP50Ns == latency.nMaxNs );
+
+    for(int i=0; i<99; i++)
+    {
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+        REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0) == 0 );
+    }
+
+    REQUIRE( pSplitter->SplitterClientLatencyGet(nClientID, &latency, true) );
+
+    REQUIRE( latency.nCount == 100 );
+    REQUIRE( latency.nP50Ns < 1000000 );
+    REQUIRE( latency.nP99Ns < 1000000 );
+    REQUIRE( latency.nP999Ns >= 20000000 );
+
+    // taken with the reset
+    REQUIRE( pSplitter->SplitterClientLatencyGet(nClientID, &latency) );
+
+    REQUIRE( latency.nCount == 0 );
+    REQUIRE( latency.nP50Ns == 0 );
+}
+
+TEST_CASE( "Memory budget", "[splitter]" )
+{
+    const uint64_t nMaxBytes = 1000;
+
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    int nMaxBufs = 0;
+    int nMaxClients = 0;
+    int nClientID = 0;
+
+    uint64_t nBudget = 0;
+    uint64_t nRetained = 0;
+
+    uint64_t nSkipped = 0;
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    SECTION("Oldest frames go first")
+    {
+        auto pSplitter = SplitterCreate(10, 1, eMode, ISplitter::OVERFLOW_BLOCK, nMaxBytes);
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 400, 0 ), 0) == 0 );
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 400, 1 ), 0) == 0 );
+
+        REQUIRE( pSplitter->SplitterInfoGet(&nMaxBufs, &nMaxClients, &nBudget, &nRetained) );
+
+        REQUIRE( nBudget == nMaxBytes );
+        REQUIRE( nRetained == 800 );
+
+        // the byte budget is hit long before the frame count
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 400, 2 ), 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        REQUIRE( pSplitter->SplitterInfoGet(&nMaxBufs, &nMaxClients, &nBudget, &nRetained) );
+
+        REQUIRE( nRetained == 800 );
+
+        // a frame over the whole budget pushes out everything else
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 5000, 3 ), 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        REQUIRE( pSplitter->SplitterInfoGet(&nMaxBufs, &nMaxClients, &nBudget, &nRetained) );
+
+        REQUIRE( nRetained == 5000 );
+
+        REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0, &nSkipped) == 0 );
+
+        REQUIRE( pFrame->front() == 3 );
+        REQUIRE( nSkipped == 3 );
+    }
+
+    SECTION("Drop newest")
+    {
+        auto pSplitter = SplitterCreate(10, 1, eMode, ISplitter::OVERFLOW_DROP_NEWEST, nMaxBytes);
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 400, 0 ), 0) == 0 );
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 400, 1 ), 0) == 0 );
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 400, 2 ), 0) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        // a smaller frame still fits
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 200, 3 ), 0) == 0 );
+
+        REQUIRE( pSplitter->SplitterInfoGet(&nMaxBufs, &nMaxClients, &nBudget, &nRetained) );
+
+        REQUIRE( nRetained == 1000 );
+
+        std::vector<TFramePtr> frames( 10 );
+
+        int nReceived = 0;
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientID, frames, &nReceived, 0) == 0 );
+
+        REQUIRE( nReceived == 3 );
+        REQUIRE( frames[2]->front() == 3 );
+    }
+}
+
+TEST_CASE( "Shared memory", "[splitter]" )
+{
+    const int nMaxBufs = 4;
+    const int nFrames = 100;
+    const size_t nFrameSize = 64;
+
+    const std::string name = "/splitter_test_" + std::to_string( getpid() );
+
+    auto pProducer = ISplitterShm::Create(name, nMaxBufs, 2, nFrameSize);
+
+    REQUIRE( pProducer );
+
+    REQUIRE_FALSE( ISplitterShm::Create(name, nMaxBufs, 2, nFrameSize) );
+
+    auto Put = [&] ( int _nValue, int _nTimeOutMsec )
+    {
+        std::vector<uint8_t> frame( nFrameSize, _nValue );
+
+        return pProducer->SplitterPut(frame.data(), frame.size(), _nTimeOutMsec);
+    };
+
+    SECTION("Zero copy from another mapping")
+    {
+        auto pConsumer = ISplitterShm::Attach(name);
+
+        REQUIRE( pConsumer );
+
+        int nClientID = 0;
+
+        uint64_t nSkipped = 0;
+
+        TShmFrame frame;
+
+        REQUIRE( pConsumer->SplitterClientAdd(&nClientID) );
+
+        REQUIRE( pConsumer->SplitterGet(nClientID, frame, 0) == ISplitter::ERR_TIMEOUT );
+
+        std::vector<uint8_t> large( nFrameSize + 1 );
+
+        REQUIRE( pConsumer->SplitterPut(large.data(), nFrameSize, 0) == ISplitter::ERR_NOT_OWNER );
+        REQUIRE( pProducer->SplitterPut(large.data(), large.size(), 0) == ISplitter::ERR_FRAME_TOO_LARGE );
+
+        for(int i=0; i<nMaxBufs; i++)
+        {
+            REQUIRE( Put( i, 0 ) == 0 );
+        }
+
+        REQUIRE( pConsumer->SplitterGet(nClientID, frame, 0) == 0 );
+
+        REQUIRE( frame.nSize == nFrameSize );
+        REQUIRE( frame.pData[0] == 0 );
+
+        // the held frame is the oldest one: the producer waits, then takes it away
+        auto start = std::chrono::steady_clock::now();
+
+        REQUIRE( Put( nMaxBufs, 20 ) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        REQUIRE( std::chrono::steady_clock::now() - start >= 20ms );
+
+        REQUIRE_FALSE( pConsumer->SplitterFrameValid(frame) );
+
+        REQUIRE( pConsumer->SplitterGet(nClientID, frame, 0, &nSkipped) == 0 );
+
+        REQUIRE( frame.pData[0] == 1 );
+        REQUIRE( pConsumer->SplitterFrameValid(frame) );
+        REQUIRE( nSkipped == 1 );
+
+        REQUIRE( pConsumer->SplitterClientRemove(nClientID) );
+
+        REQUIRE( pConsumer->SplitterGet(nClientID, frame, 0) == ISplitter::ERR_BAD_CLIENT_ID );
+    }
+
+    SECTION("Consumer process")
+    {
+        pid_t pid = fork();
+
+        if ( pid == 0 )
+        {
+            auto pConsumer = ISplitterShm::Attach(name);
+
+            int nClientID = 0;
+
+            if ( not pConsumer || not pConsumer->SplitterClientAdd(&nClientID) ) _exit( 1 );
+
+            TShmFrame frame;
+
+            for(int i=0; i<nFrames; i++)
+            {
+                if ( pConsumer->SplitterGet(nClientID, frame, 5000) != 0 ) _exit( 2 );
+
+                bool bGood = frame.nSize == nFrameSize && std::count( frame.pData, frame.pData + frame.nSize, i ) == nFrameSize;
+
+                if ( not bGood || not pConsumer->SplitterFrameValid(frame) ) _exit( 3 );
+            }
+
+            _exit( pConsumer->SplitterClientRemove(nClientID) ? 0 : 4 );
+        }
+
+        REQUIRE( pid > 0 );
+
+        int nCount = 0;
+
+        for(int i=0; i<500 && nCount == 0; i++)
+        {
+            std::this_thread::sleep_for( 10ms );
+
+            REQUIRE( pProducer->SplitterClientGetCount(&nCount) );
+        }
+
+        REQUIRE( nCount == 1 );
+
+        // the consumer takes every frame
+        for(int i=0; i<nFrames; i++)
+        {
+            REQUIRE( Put( i, 5000 ) == 0 );
+        }
+
+        int status = 0;
+
+        REQUIRE( waitpid(pid, &status, 0) == pid );
+
+        REQUIRE( WIFEXITED(status) );
+        REQUIRE( WEXITSTATUS(status) == 0 );
+
+        REQUIRE( pProducer->SplitterClientGetCount(&nCount) );
+
+        REQUIRE( nCount == 0 );
+    }
+
+    SECTION("Crashed consumer is reaped")
+    {
+        pid_t pid = fork();
+
+        if ( pid == 0 )
+        {
+            auto pConsumer = ISplitterShm::Attach(name);
+
+            int nClientID = 0;
+
+            // exits holding the client
+            _exit( pConsumer && pConsumer->SplitterClientAdd(&nClientID) ? 0 : 1 );
+        }
+
+        REQUIRE( pid > 0 );
+
+        int status = 0;
+
+        REQUIRE( waitpid(pid, &status, 0) == pid );
+
+        REQUIRE( WIFEXITED(status) );
+        REQUIRE( WEXITSTATUS(status) == 0 );
+
+        int nCount = 0;
+
+        REQUIRE( pProducer->SplitterClientGetCount(&nCount) );
+
+        REQUIRE( nCount == 1 );
+
+        for(int i=0; i<nMaxBufs; i++)
+        {
+            REQUIRE( Put( i, 0 ) == 0 );
+        }
+
+        // the dead client would hold the oldest frame for the whole timeout
+        auto start = std::chrono::steady_clock::now();
+
+        REQUIRE( Put( nMaxBufs, 5000 ) == 0 );
+
+        REQUIRE( std::chrono::steady_clock::now() - start < 1s );
+
+        REQUIRE( pProducer->SplitterClientGetCount(&nCount) );
+
+        REQUIRE( nCount == 0 );
+    }
+}
+
+TEST_CASE( "Client eventfd", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    auto pSplitter = SplitterCreate(8, 2, eMode);
+
+    int nClientID = 0;
+    int nFd = -1;
+
+    std::shared_ptr<std::vector<uint8_t>> pFrame;
+
+    auto Readable = [&] ()
+    {
+        pollfd fd{ nFd, POLLIN, 0 };
+
+        return poll(&fd, 1, 0) == 1 && ( fd.revents & POLLIN );
+    };
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+    REQUIRE_FALSE( pSplitter->SplitterClientGetFd(nClientID + 1, &nFd) );
+    REQUIRE( pSplitter->SplitterClientGetFd(nClientID, &nFd) );
+
+    REQUIRE_FALSE( Readable() );
+
+    SECTION("Readable while frames are pending")
+    {
+        for(int i=0; i<3; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 0) == 0 );
+        }
+
+        REQUIRE( Readable() );
+
+        REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0) == 0 );
+
+        REQUIRE( Readable() );
+
+        std::vector<TFramePtr> frames( 8 );
+
+        int nReceived = 0;
+
+        REQUIRE( pSplitter->SplitterGetBatch(nClientID, frames, &nReceived, 0) == 0 );
+
+        REQUIRE( nReceived == 2 );
+        REQUIRE_FALSE( Readable() );
+
+        REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0) == ISplitter::ERR_TIMEOUT );
+        REQUIRE_FALSE( Readable() );
+
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0) == 0 );
+
+        REQUIRE( Readable() );
+    }
+
+    SECTION("A burst costs one write")
+    {
+        for(int i=0; i<5; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 0) == 0 );
+        }
+
+        uint64_t nWrites = 0;
+
+        REQUIRE( read(nFd, &nWrites, sizeof(nWrites)) == sizeof(nWrites) );
+
+        REQUIRE( nWrites == 1 );
+    }
+
+    SECTION("Wakes a blocked poll")
+    {
+        std::thread producer( [&] {
+            std::this_thread::sleep_for( 20ms );
+
+            pSplitter->SplitterPut(std::make_shared<TFrame>( 1 ), 0);
+        });
+
+        pollfd fd{ nFd, POLLIN, 0 };
+
+        int res = poll(&fd, 1, 5000);
+
+        producer.join();
+
+        REQUIRE( res == 1 );
+
+        REQUIRE( pSplitter->SplitterGet(nClientID, pFrame, 0) == 0 );
+    }
+
+    SECTION("Removal and close")
+    {
+        int nOtherID = 0;
+        int nOtherFd = -1;
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nOtherID) );
+        REQUIRE( pSplitter->SplitterClientGetFd(nOtherID, &nOtherFd) );
+
+        REQUIRE( pSplitter->SplitterClientRemove(nOtherID) );
+
+        pollfd fd{ nOtherFd, POLLIN, 0 };
+
+        REQUIRE( poll(&fd, 1, 0) == 1 );
+
+        REQUIRE_FALSE( Readable() );
+
+        pSplitter->SplitterClose();
+
+        REQUIRE( Readable() );
+    }
+}
+
+// Coroutine started right away and never awaited
+struct TDetachedTask
+{
+    struct promise_type
+    {
+        TDetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static TDetachedTask StreamFrames( ISplitter* _pSplitter, int _nClientID, std::atomic<int>* _pnFrames, std::atomic<int>* _pnDone, std::atomic<int>* _pnBadOrder )
+{
+    auto stream = _pSplitter->Stream( _nClientID );
+
+    int nExpected = 0;
+
+    while ( auto pFrame = co_await stream.Next() )
+    {
+        if ( pFrame->front() != nExpected++ ) (*_pnBadOrder)++;
+
+        (*_pnFrames)++;
+    }
+
+    if ( stream.Error() == ISplitter::ERR_SPLITTER_IS_CLOSED ) (*_pnDone)++;
+}
+
+static TDetachedTask GetFrame( ISplitter* _pSplitter, int _nClientID, int _nTimeOutMsec, std::promise<TSplitterGetResult>* _pResult )
+{
+    _pResult->set_value( co_await _pSplitter->Get( _nClientID, _nTimeOutMsec ) );
+}
+
+TEST_CASE( "Coroutines", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    SECTION("Get with a timeout")
+    {
+        auto pSplitter = SplitterCreate(4, 1, eMode);
+
+        int nClientID = 0;
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+        std::promise<TSplitterGetResult> timedOut;
+
+        auto start = std::chrono::steady_clock::now();
+
+        GetFrame( pSplitter.get(), nClientID, 20, &timedOut );
+
+        auto result = timedOut.get_future().get();
+
+        REQUIRE( result.nError == ISplitter::ERR_TIMEOUT );
+        REQUIRE( std::chrono::steady_clock::now() - start >= 20ms );
+
+        std::promise<TSplitterGetResult> got;
+
+        auto future = got.get_future();
+
+        GetFrame( pSplitter.get(), nClientID, 5000, &got );
+
+        REQUIRE( future.wait_for( 20ms ) == std::future_status::timeout );
+
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, 7 ), 0) == 0 );
+
+        result = future.get();
+
+        REQUIRE( result.nError == 0 );
+        REQUIRE( result.pFrame->front() == 7 );
+    }
+
+    SECTION("Thousand clients on one thread")
+    {
+        const int nClients = 1000;
+        const int nFrames = 20;
+
+        auto pSplitter = SplitterCreate(8, nClients, eMode);
+
+        std::atomic<int> nDone{0};
+        std::atomic<int> nBadOrder{0};
+
+        std::vector<std::atomic<int>> frames( nClients );
+
+        for(int i=0; i<nClients; i++)
+        {
+            int nClientID = 0;
+
+            REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+            StreamFrames( pSplitter.get(), nClientID, &frames[i], &nDone, &nBadOrder );
+        }
+
+        for(int i=0; i<nFrames; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 5000) == 0 );
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + 10s;
+
+        auto AllGot = [&] { return std::all_of( frames.begin(), frames.end(), [&] (auto& n) { return n == nFrames; } ); };
+
+        while ( not AllGot() && std::chrono::steady_clock::now() < deadline )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+
+        REQUIRE( AllGot() );
+
+        pSplitter->SplitterClose();
+
+        while ( nDone < nClients && std::chrono::steady_clock::now() < deadline )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+
+        REQUIRE( nDone == nClients );
+        REQUIRE( nBadOrder == 0 );
+    }
+}
+
+TEST_CASE( "Subscriptions", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    SECTION("Ordered delivery on a stealing pool")
+    {
+        const int nClients = 100;
+        const int nFrames = 200;
+
+        auto pSplitter = SplitterCreate(8, nClients, eMode);
+
+        // destroyed first: finishes the closed subscriptions while the splitter is alive
+        ISplitterThreadPool pool( 4 );
+
+        std::vector<int> expected( nClients, 0 );
+        std::vector<std::atomic<int>> frames( nClients );
+        std::atomic<int> nBadOrder{0};
+
+        std::vector<int> ids( nClients );
+
+        for(int i=0; i<nClients; i++)
+        {
+            auto OnFrame = [&, i] (const TFramePtr& _pFrame, uint64_t) {
+                if ( _pFrame->front() != expected[i]++ ) nBadOrder++;
+
+                frames[i]++;
+            };
+
+            // half on the splitter's own dispatcher
+            REQUIRE( pSplitter->SplitterSubscribe( OnFrame, i % 2 ? pool.Executor() : nullptr, &ids[i] ) );
+        }
+
+        for(int i=0; i<nFrames; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i % 256 ), 5000) == 0 );
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + 10s;
+
+        auto AllGot = [&] { return std::all_of( frames.begin(), frames.end(), [&] (auto& n) { return n == nFrames; } ); };
+
+        while ( not AllGot() && std::chrono::steady_clock::now() < deadline )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+
+        REQUIRE( AllGot() );
+        REQUIRE( nBadOrder == 0 );
+
+        // the removed subscriber gets nothing more, its id goes to a plain client
+        REQUIRE( pSplitter->SplitterClientRemove( ids[0] ) );
+
+        int nClientID = 0;
+
+        REQUIRE( pSplitter->SplitterClientAdd( &nClientID ) );
+        REQUIRE( nClientID == ids[0] );
+
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, nFrames % 256 ), 5000) == 0 );
+
+        TFramePtr pFrame;
+
+        REQUIRE( pSplitter->SplitterGet( nClientID, pFrame, 1000 ) == 0 );
+
+        std::this_thread::sleep_for( 20ms );
+
+        REQUIRE( frames[0] == nFrames );
+
+        pSplitter->SplitterClose();
+    }
+
+    SECTION("Slow callback is a slow client")
+    {
+        auto pSplitter = SplitterCreate(2, 1, eMode);
+
+        std::promise<void> gate;
+        auto gateOpen = gate.get_future().share();
+
+        std::atomic<int> nFrames{0};
+        std::atomic<uint64_t> nSkipped{0};
+        std::atomic<bool> bInCallback{false};
+
+        int nClientID = 0;
+
+        REQUIRE( pSplitter->SplitterSubscribe( [&] (const TFramePtr& _pFrame, uint64_t _nSkipped) {
+            nSkipped += _nSkipped;
+
+            if ( _pFrame->front() == 0 )
+            {
+                bInCallback = true;
+
+                gateOpen.wait();
+            }
+            nFrames++;
+        }, nullptr, &nClientID ) );
+
+        for(int i=0; i<3; i++)
+        {
+            REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, i ), 1000) == 0 );
+        }
+
+        while ( not bInCallback )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        REQUIRE( pSplitter->SplitterPut(std::make_shared<TFrame>( 1, 3 ), 50) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+        REQUIRE( std::chrono::steady_clock::now() - start >= 50ms );
+
+        gate.set_value();
+
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+
+        while ( nFrames < 3 && std::chrono::steady_clock::now() < deadline )
+        {
+            std::this_thread::sleep_for( 1ms );
+        }
+
+        REQUIRE( nFrames == 3 );
+        REQUIRE( nSkipped == 1 );
+
+        pSplitter->SplitterClose();
+    }
+}
+
+TEST_CASE( "Try and deadline calls", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    auto pSplitter = SplitterCreate(2, 1, eMode);
+
+    int nClientID = 0;
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+    TFramePtr pFrame;
+
+    SECTION("Try never waits")
+    {
+        REQUIRE( pSplitter->SplitterTryGet( nClientID, pFrame ) == ISplitter::ERR_TIMEOUT );
+
+        REQUIRE( pSplitter->SplitterTryPut( std::make_shared<TFrame>( 1, 0 ) ) == 0 );
+        REQUIRE( pSplitter->SplitterTryPut( std::make_shared<TFrame>( 1, 1 ) ) == 0 );
+
+        // the client still needs the oldest frame
+        REQUIRE( pSplitter->SplitterTryPut( std::make_shared<TFrame>( 1, 2 ) ) == ISplitter::ERR_TIMEOUT );
+
+        uint64_t nSkipped = 1;
+
+        REQUIRE( pSplitter->SplitterTryGet( nClientID, pFrame, &nSkipped ) == 0 );
+        REQUIRE( pFrame->front() == 0 );
+        REQUIRE( nSkipped == 0 );
+
+        REQUIRE( pSplitter->SplitterTryPut( std::make_shared<TFrame>( 1, 2 ) ) == 0 );
+
+        for(int i=1; i<3; i++)
+        {
+            REQUIRE( pSplitter->SplitterTryGet( nClientID, pFrame, &nSkipped ) == 0 );
+            REQUIRE( pFrame->front() == i );
+            REQUIRE( nSkipped == 0 );
+        }
+    }
+
+    SECTION("Deadlines")
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        REQUIRE( pSplitter->SplitterGet( nClientID, pFrame, start + 20ms ) == ISplitter::ERR_TIMEOUT );
+        REQUIRE( std::chrono::steady_clock::now() - start >= 20ms );
+
+        REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, 0 ), start ) == 0 );
+        REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, 1 ), start ) == 0 );
+
+        start = std::chrono::steady_clock::now();
+
+        REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, 2 ), start + 20ms ) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+        REQUIRE( std::chrono::steady_clock::now() - start >= 20ms );
+
+        REQUIRE( pSplitter->SplitterGet( nClientID, pFrame, start ) == 0 );
+        REQUIRE( pFrame->front() == 1 );
+    }
+
+    SECTION("Wakeups without a frame do not end the wait")
+    {
+        std::atomic<int> nResult{-1};
+        std::atomic<bool> bEarly{false};
+
+        std::thread client( [&] {
+            auto start = std::chrono::steady_clock::now();
+
+            TFramePtr pGot;
+
+            int res = pSplitter->SplitterGet( nClientID, pGot, start + 100ms );
+
+            bEarly = res == ISplitter::ERR_TIMEOUT && std::chrono::steady_clock::now() - start < 100ms;
+
+            nResult = res;
+        });
+
+        // each frame wakes the client, the flush may take it away again
+        for(int i=0; i<50 && nResult < 0; i++)
+        {
+            pSplitter->SplitterPut( std::make_shared<TFrame>( 1, i ), 0 );
+
+            pSplitter->SplitterFlush();
+        }
+
+        client.join();
+
+        REQUIRE( ( nResult == 0 || nResult == ISplitter::ERR_TIMEOUT ) );
+        REQUIRE( not bEarly );
+    }
+}
+
+TEST_CASE( "Wait strategies", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+    auto eWait = GENERATE( ISplitter::WAIT_BLOCK, ISplitter::WAIT_SPIN, ISplitter::WAIT_YIELD, ISplitter::WAIT_ADAPTIVE );
+
+    const int nClients = 2;
+    const int nFrames = 100;
+
+    auto pSplitter = SplitterCreate(4, nClients, eMode);
+
+    REQUIRE( pSplitter->SplitterWaitStrategySet( eWait ) );
+
+    std::vector<int> ids( nClients );
+
+    for (auto& id : ids)
+    {
+        REQUIRE( pSplitter->SplitterClientAdd(&id) );
+    }
+
+    TFramePtr pFrame;
+
+    auto start = std::chrono::steady_clock::now();
+
+    REQUIRE( pSplitter->SplitterGet( ids[0], pFrame, 10 ) == ISplitter::ERR_TIMEOUT );
+    REQUIRE( std::chrono::steady_clock::now() - start >= 10ms );
+
+    std::atomic<int> nBad{0};
+
+    std::vector<std::thread> clients;
+
+    for (auto id : ids)
+    {
+        clients.emplace_back( [&, id] {
+            TFramePtr pGot;
+
+            for(int i=0; i<nFrames; i++)
+            {
+                if ( pSplitter->SplitterGet( id, pGot, 5000 ) != 0 || pGot->front() != i ) nBad++;
+            }
+        });
+    }
+
+    int nForced = 0;
+
+    for(int i=0; i<nFrames; i++)
+    {
+        if ( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, i ), 5000 ) != 0 ) nForced++;
+    }
+
+    for (auto& client : clients)
+    {
+        client.join();
+    }
+
+    REQUIRE( nForced == 0 );
+    REQUIRE( nBad == 0 );
+}
+
+TEMPLATE_TEST_CASE( "Policy-based splitter", "[splitter]"
+                  , (BasicSplitter<>)
+                  , (BasicSplitter<TDequeStorage, TAdaptiveWait, TOverflowBlock, TMutexLock>)
+                  , (BasicSplitter<ISplitterRing, TSpinWait, TOverflowBlock, TSharedMutexLock>) )
+{
+    const int nClients = 3;
+    const int nFrames = 200;
+
+    TestType splitter( 4, nClients );
+
+    std::vector<int> ids( nClients );
+
+    for (auto& id : ids)
+    {
+        REQUIRE( splitter.SplitterClientAdd(&id) );
+    }
+
+    TFramePtr pFrame;
+
+    REQUIRE( splitter.SplitterTryGet( ids[0], pFrame ) == ISplitter::ERR_TIMEOUT );
+    REQUIRE( splitter.SplitterGet( ids[0], pFrame, 5 ) == ISplitter::ERR_TIMEOUT );
+
+    std::atomic<int> nBad{0};
+
+    std::vector<std::thread> clients;
+
+    for (auto id : ids)
+    {
+        clients.emplace_back( [&, id] {
+            TFramePtr pGot;
+
+            for(int i=0; i<nFrames; i++)
+            {
+                if ( splitter.SplitterGet( id, pGot, 5000 ) != 0 || pGot->front() != i % 256 ) nBad++;
+            }
+        });
+    }
+
+    int nForced = 0;
+
+    for(int i=0; i<nFrames; i++)
+    {
+        if ( splitter.SplitterPut( std::make_shared<TFrame>( 1, i % 256 ), 5000 ) != 0 ) nForced++;
+    }
+
+    for (auto& client : clients)
+    {
+        client.join();
+    }
+
+    REQUIRE( nForced == 0 );
+    REQUIRE( nBad == 0 );
+
+    splitter.SplitterClose();
+
+    REQUIRE( splitter.SplitterGet( ids[0], pFrame, 5 ) == ISplitter::ERR_SPLITTER_IS_CLOSED );
+}
+
+TEST_CASE( "Policy-based splitter overflow", "[splitter]" )
+{
+    TFramePtr pFrame;
+
+    uint64_t nSkipped = 0;
+
+    int nClientID = 0;
+
+    SECTION("Block, single thread")
+    {
+        BasicSplitter<ISplitterRing, TBlockWait, TOverflowBlock, TNoLock> splitter( 2, 1 );
+
+        REQUIRE( splitter.SplitterClientAdd(&nClientID) );
+
+        REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, 0 ), 0 ) == 0 );
+        REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, 1 ), 0 ) == 0 );
+        REQUIRE( splitter.SplitterTryPut( std::make_shared<TFrame>( 1, 2 ) ) == ISplitter::ERR_TIMEOUT );
+        REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, 2 ), 1 ) == ISplitter::ERR_FORCED_FRAMES_REMOVE );
+
+        REQUIRE( splitter.SplitterGet( nClientID, pFrame, 0, &nSkipped ) == 0 );
+        REQUIRE( pFrame->front() == 1 );
+        REQUIRE( nSkipped == 1 );
+    }
+
+    SECTION("Drop newest")
+    {
+        BasicSplitter<TDequeStorage, TBlockWait, TOverflowDropNewest, TNoLock> splitter( 2, 1 );
+
+        REQUIRE( splitter.SplitterClientAdd(&nClientID) );
+
+        for(int i=0; i<3; i++)
+        {
+            REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, i ), 1000 ) == ( i < 2 ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+        }
+
+        REQUIRE( splitter.SplitterGet( nClientID, pFrame, 0, &nSkipped ) == 0 );
+        REQUIRE( pFrame->front() == 0 );
+        REQUIRE( nSkipped == 1 );
+    }
+
+    SECTION("Drop oldest")
+    {
+        BasicSplitter<ISplitterRing, TBlockWait, TOverflowDropOldest, TNoLock> splitter( 2, 1 );
+
+        REQUIRE( splitter.SplitterClientAdd(&nClientID) );
+
+        for(int i=0; i<3; i++)
+        {
+            REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, i ), 1000 ) == ( i < 2 ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+        }
+
+        REQUIRE( splitter.SplitterGet( nClientID, pFrame, 0, &nSkipped ) == 0 );
+        REQUIRE( pFrame->front() == 1 );
+        REQUIRE( nSkipped == 1 );
+    }
+
+    SECTION("Put publishes before it waits")
+    {
+        BasicSplitter<ISplitterRing, TBlockWait, TOverflowBlock, TMutexLock> splitter( 2, 2 );
+
+        int nFast = 0;
+        int nSlow = 0;
+
+        REQUIRE( splitter.SplitterClientAdd(&nFast) );
+        REQUIRE( splitter.SplitterClientAdd(&nSlow) );
+
+        REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, 0 ), 0 ) == 0 );
+        REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 1, 1 ), 0 ) == 0 );
+
+        REQUIRE( splitter.SplitterGet( nFast, pFrame, 0 ) == 0 );
+        REQUIRE( splitter.SplitterGet( nFast, pFrame, 0 ) == 0 );
+
+        int nPut = -1;
+
+        std::thread producer( [&] { nPut = splitter.SplitterPut( std::make_shared<TFrame>( 1, 2 ), 5000 ); } );
+
+        // the producer waits for the slow client, the fast one already has the frame
+        REQUIRE( splitter.SplitterGet( nFast, pFrame, 5000 ) == 0 );
+        REQUIRE( pFrame->front() == 2 );
+
+        REQUIRE( splitter.SplitterGet( nSlow, pFrame, 0, &nSkipped ) == 0 );
+        REQUIRE( pFrame->front() == 0 );
+
+        producer.join();
+
+        REQUIRE( nPut == 0 );
+        REQUIRE( nSkipped == 0 );
+    }
+
+    SECTION("Byte budget and snapshot")
+    {
+        BasicSplitter<TDequeStorage, TBlockWait, TOverflowDropOldest, TNoLock> splitter( 8, 3, 100 );
+
+        int ids[2] = {};
+
+        REQUIRE( splitter.SplitterClientAdd(&ids[0]) );
+        REQUIRE( splitter.SplitterClientAdd(&ids[1]) );
+
+        for(int i=0; i<3; i++)
+        {
+            REQUIRE( splitter.SplitterPut( std::make_shared<TFrame>( 40, i ), 0 ) == ( i < 2 ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE ) );
+        }
+
+        int nMaxBuffers = 0;
+        int nMaxClients = 0;
+        uint64_t nMaxBytes = 0;
+        uint64_t nRetained = 0;
+
+        REQUIRE( splitter.SplitterInfoGet(&nMaxBuffers, &nMaxClients, &nMaxBytes, &nRetained) );
+        REQUIRE( nMaxBytes == 100 );
+        REQUIRE( nRetained == 80 );
+
+        REQUIRE( splitter.SplitterGet( ids[1], pFrame, 0 ) == 0 );
+        REQUIRE( pFrame->front() == 1 );
+
+        TSplitterClientInfo info[3];
+
+        int nCount = 0;
+
+        REQUIRE( splitter.SplitterClientsSnapshot( info, 3, &nCount ) );
+
+        REQUIRE( nCount == 2 );
+        REQUIRE( info[0].nClientID == ids[0] );
+        REQUIRE( info[0].nLatency == 2 );
+        REQUIRE( info[0].nLatencyBytes == 80 );
+        REQUIRE( info[0].nDropped == 1 );
+        REQUIRE( info[1].nLatency == 1 );
+        REQUIRE( info[1].nDropped == 1 );
+
+        int nLatency = 0;
+
+        REQUIRE( splitter.SplitterClientGetByIndex( 1, &nClientID, &nLatency ) );
+        REQUIRE( nClientID == ids[1] );
+        REQUIRE( nLatency == 1 );
+
+        REQUIRE_FALSE( splitter.SplitterClientGetByIndex( 2, &nClientID, &nLatency ) );
+    }
+}
+
+TEST_CASE( "Client churn", "[splitter]" )
+{
+    auto eMode = GENERATE( ISplitter::MODE_SHARED_LOCK, ISplitter::MODE_SINGLE_PRODUCER );
+
+    SECTION("Removing the slow client releases the producer")
+    {
+        auto pSplitter = SplitterCreate(2, 2, eMode);
+
+        int nSlowID = 0;
+
+        REQUIRE( pSplitter->SplitterClientAdd(&nSlowID) );
+
+        REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, 0 ), 0 ) == 0 );
+        REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, 1 ), 0 ) == 0 );
+
+        std::thread remover( [&] {
+            std::this_thread::sleep_for( 20ms );
+
+            pSplitter->SplitterClientRemove( nSlowID );
+        });
+
+        auto start = std::chrono::steady_clock::now();
+
+        int res = pSplitter->SplitterPut( std::make_shared<TFrame>( 1, 2 ), 5000 );
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        remover.join();
+
+        REQUIRE( res == 0 );
+        REQUIRE( elapsed < 2s );
+    }
+
+    SECTION("Removing a client interrupts its get")
+    {
+        auto pSplitter = SplitterCreate(2, 1, eMode);
+
+        // the remove lands at different points of the get, up to the moment it parks
+        for(int i=0; i<200; i++)
+        {
+            int nClientID = 0;
+
+            REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+            int res = 0;
+
+            auto elapsed = 0ms;
+
+            std::thread getter( [&] {
+                TFramePtr pFrame;
+
+                auto start = std::chrono::steady_clock::now();
+
+                res = pSplitter->SplitterGet( nClientID, pFrame, 1000 );
+
+                elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start );
+            });
+
+            std::this_thread::sleep_for( std::chrono::microseconds( i % 50 ) );
+
+            REQUIRE( pSplitter->SplitterClientRemove( nClientID ) );
+
+            getter.join();
+
+            REQUIRE( res == ISplitter::ERR_BAD_CLIENT_ID );
+            REQUIRE( elapsed < 500ms );
+        }
+    }
+
+    SECTION("A get of the removed client does not take frames of the re-added one")
+    {
+        auto pSplitter = SplitterCreate(2, 1, eMode);
+
+        for(int i=0; i<20; i++)
+        {
+            int nClientID = 0;
+
+            REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+
+            int res = 0;
+
+            std::thread getter( [&] {
+                TFramePtr pFrame;
+
+                res = pSplitter->SplitterGet( nClientID, pFrame, 1000 );
+            });
+
+            // the get is parked by now
+            std::this_thread::sleep_for( 5ms );
+
+            int nOldID = nClientID;
+
+            REQUIRE( pSplitter->SplitterClientRemove( nOldID ) );
+
+            // the lowest free id goes to the new owner, and a frame for it follows at once
+            int nNewID = 0;
+
+            REQUIRE( pSplitter->SplitterClientAdd(&nNewID) );
+            REQUIRE( nNewID == nOldID );
+
+            REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, i ), 0 ) == 0 );
+
+            getter.join();
+
+            REQUIRE( res == ISplitter::ERR_BAD_CLIENT_ID );
+
+            TFramePtr pFrame;
+
+            REQUIRE( pSplitter->SplitterGet( nNewID, pFrame, 0 ) == 0 );
+            REQUIRE( pFrame->at( 0 ) == i );
+
+            REQUIRE( pSplitter->SplitterClientRemove( nNewID ) );
+        }
+    }
+
+    SECTION("Clients come and go while frames flow")
+    {
+        const int nChurners = 4;
+
+        auto pSplitter = SplitterCreate(8, nChurners, eMode, ISplitter::OVERFLOW_DROP_OLDEST);
+
+        std::atomic<bool> bStop{false};
+        std::atomic<int> nBad{0};
+        std::atomic<int> nSessions{0};
+
+        std::vector<std::thread> churners;
+
+        for(int i=0; i<nChurners; i++)
+        {
+            churners.emplace_back( [&] {
+                while ( not bStop )
+                {
+                    int nClientID = 0;
+
+                    if ( not pSplitter->SplitterClientAdd(&nClientID) ) continue;
+
+                    TFramePtr pFrame;
+
+                    int nLast = -1;
+
+                    for(int j=0; j<5; j++)
+                    {
+                        int res = pSplitter->SplitterGet( nClientID, pFrame, 10 );
+
+                        if ( res == ISplitter::ERR_TIMEOUT ) continue;
+
+                        int nSeq = -1;
+
+                        if ( res == 0 ) std::memcpy( &nSeq, pFrame->data(), sizeof( nSeq ) );
+
+                        // frames of one session only go forward
+                        if ( res != 0 || nSeq <= nLast ) nBad++;
+
+                        nLast = nSeq;
+                    }
+
+                    if ( not pSplitter->SplitterClientRemove( nClientID ) ) nBad++;
+
+                    nSessions++;
+                }
+            });
+        }
+
+        for(int i=0; i<20000; i++)
+        {
+            auto pFrame = std::make_shared<TFrame>( sizeof( i ) );
+
+            std::memcpy( pFrame->data(), &i, sizeof( i ) );
+
+            pSplitter->SplitterPut( pFrame, 0 );
+
+            if ( i % 256 == 255 ) std::this_thread::sleep_for( 1ms );
+        }
+
+        bStop = true;
+
+        for (auto& churner : churners)
+        {
+            churner.join();
+        }
+
+        int nCount = -1;
+
+        REQUIRE( pSplitter->SplitterClientGetCount(&nCount) );
+        REQUIRE( nCount == 0 );
+        REQUIRE( nSessions > 0 );
+        REQUIRE( nBad == 0 );
+    }
+}
+
+TEST_CASE( "Client table layout", "[splitter]" )
+{
+    ISplitterClientTable table( 5 );
+
+    REQUIRE( table.size() == 5 );
+
+    for ( size_t i = 0; i < table.size(); i++ )
+    {
+        auto address = reinterpret_cast<uintptr_t>( &table[ i ] );
+
+        REQUIRE( table[ i ].Id() == static_cast<int>( i + 1 ) );
+        REQUIRE( address % CACHE_LINE_SIZE == 0 );
+
+        // one contiguous block, the neighbours' cursors are never on the same line
+        if ( i > 0 ) REQUIRE( address - reinterpret_cast<uintptr_t>( &table[ i - 1 ] ) == sizeof( ISplitterClient ) );
+    }
+    REQUIRE( sizeof( ISplitterClient ) % CACHE_LINE_SIZE == 0 );
+}
+
+TEST_CASE( "Client ids iterate taken only", "[splitter]" )
+{
+    const int nCount = 5000;
+
+    ISplitterClientIds ids( nCount );
+
+    REQUIRE( ids.Next( 0 ) == 0 );
+    REQUIRE( ids.Nth( 0 ) == 0 );
+
+    for ( int i = 0; i < nCount; i++ )
+    {
+        REQUIRE( ids.Acquire() == i + 1 );
+    }
+
+    // kept ones sit at the word and summary word edges
+    std::vector<int> kept = { 1, 64, 65, 4096, 4097, 4999, 5000 };
+
+    for ( int id = 1; id <= nCount; id++ )
+    {
+        if ( std::find( kept.begin(), kept.end(), id ) == kept.end() ) ids.Release( id );
+    }
+
+    std::vector<int> walked;
+
+    for ( int id = ids.Next( 0 ); id != 0; id = ids.Next( id ) )
+    {
+        walked.push_back( id );
+    }
+
+    REQUIRE( walked == kept );
+
+    for ( size_t i = 0; i < kept.size(); i++ )
+    {
+        REQUIRE( ids.Nth( i ) == kept[i] );
+    }
+    REQUIRE( ids.Nth( kept.size() ) == 0 );
+
+    ids.Release( 1 );
+    ids.Release( 5000 );
+
+    REQUIRE( ids.Next( 0 ) == 64 );
+    REQUIRE( ids.Next( 4999 ) == 0 );
+    REQUIRE( ids.Nth( 0 ) == 64 );
+}
+
+TEST_CASE( "Clients counted per frame", "[splitter]" )
+{
+    ISplitterRing ring( 2 );
+
+    ISplitterClientTable table( 2 );
+
+    table[ 0 ].Activate( ring, ring.End() );
+    table[ 1 ].Activate( ring, ring.End() );
+
+    REQUIRE( ring.ClientsAt( 0 ) == 2 );
+
+    // past the capacity: the ring grows and keeps the counts
+    for ( int i = 0; i < 3; i++ )
+    {
+        ring.push_back( std::make_shared<TFrame>( 1, i ) );
+    }
+
+    TFramePtr frames[ 2 ];
+
+    REQUIRE( table[ 0 ].PopFrames( ring, frames, 2, table[ 0 ].Generation() ) == 2 );
+
+    REQUIRE( ring.ClientsAt( 0 ) == 1 );
+    REQUIRE( ring.ClientsAt( 2 ) == 1 );
+
+    REQUIRE( table[ 1 ].FrameIncrement( ring, 0 ) );
+
+    ring.pop_front();
+
+    REQUIRE( ring.ClientsAt( ring.Begin() ) == 1 );
+
+    table[ 0 ].SetNextFrame( ring, ring.End() );
+    table[ 1 ].Deactivate( ring );
+
+    REQUIRE( ring.ClientsAt( 1 ) == 0 );
+    REQUIRE( ring.ClientsAt( ring.End() ) == 1 );
+}
+
+TEST_CASE( "Many idle clients", "[splitter]" )
+{
+    const int CLIENTS = 100000;
+
+    auto pSplitter = SplitterCreate(4, CLIENTS, ISplitter::MODE_SHARED_LOCK, ISplitter::OVERFLOW_DROP_OLDEST);
+
+    int nClientID = 0;
+
+    int nAdded = 0;
+
+    for ( int i = 0; i < CLIENTS; i++ )
+    {
+        nAdded += pSplitter->SplitterClientAdd(&nClientID);
+    }
+
+    REQUIRE( nAdded == CLIENTS );
+
+    REQUIRE_FALSE( pSplitter->SplitterClientAdd(&nClientID) );
+
+    for ( int i = 0; i < 10; i++ )
+    {
+        int nExpected = i < 4 ? 0 : ISplitter::ERR_FORCED_FRAMES_REMOVE;
+
+        REQUIRE( pSplitter->SplitterPut( std::make_shared<TFrame>( 1, i ), 0 ) == nExpected );
+    }
+
+    // the clients left behind skip the dropped frames on their next get
+    std::vector<TSplitterClientInfo> info( 2 );
+
+    int nCount = 0;
+
+    REQUIRE( pSplitter->SplitterClientsSnapshot( info.data(), info.size(), &nCount ) );
+
+    REQUIRE( info[0].nDropped == 6 );
+
+    TFramePtr pFrame;
+
+    uint64_t nSkipped = 0;
+
+    REQUIRE( pSplitter->SplitterGet( 1, pFrame, 0, &nSkipped ) == 0 );
+
+    REQUIRE( nSkipped == 6 );
+    REQUIRE( (*pFrame)[0] == 6 );
+
+    // the freed ids come back lowest first
+    REQUIRE( pSplitter->SplitterClientRemove( 70000 ) );
+    REQUIRE( pSplitter->SplitterClientRemove( 3 ) );
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+    REQUIRE( nClientID == 3 );
+
+    REQUIRE( pSplitter->SplitterClientAdd(&nClientID) );
+    REQUIRE( nClientID == 70000 );
+}